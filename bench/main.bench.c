@@ -0,0 +1,1265 @@
+#define _POSIX_C_SOURCE 200809L
+
+#if defined(__linux__)
+    // syscall() for perf_event_open()
+    #define _DEFAULT_SOURCE
+#endif // __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+#endif // __linux__
+
+#if defined(__linux__)
+    #define CAP_PROC_SCANNER
+#endif // __linux__
+
+#define CAP_PARALLEL_TOKENIZE
+#define CAP_ARENA
+#define CAP_CONFIG_FILES
+#define CAP_IMPLEMENTATION
+#include "../cap.h"
+
+#if defined(CAP_HASHED_LFLAGS)
+    #define MODE "hashed"
+#elif defined(CAP_STATS)
+    // The same cases as "linear" with the counters and the trace hook check compiled in
+    #define MODE "stats"
+#else
+    #define MODE "linear"
+#endif // CAP_HASHED_LFLAGS
+
+#define ROUNDS 20000
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+#define OPTION(NAME) CAP_MATCH_LFLAG("opt-" NAME, { hits++; })
+#define OPTIONS_10(P)\
+    OPTION(P "0") OPTION(P "1") OPTION(P "2") OPTION(P "3") OPTION(P "4")\
+    OPTION(P "5") OPTION(P "6") OPTION(P "7") OPTION(P "8") OPTION(P "9")
+#define OPTIONS_100(P)\
+    OPTIONS_10(P "0") OPTIONS_10(P "1") OPTIONS_10(P "2") OPTIONS_10(P "3") OPTIONS_10(P "4")\
+    OPTIONS_10(P "5") OPTIONS_10(P "6") OPTIONS_10(P "7") OPTIONS_10(P "8") OPTIONS_10(P "9")
+
+// Every option set declares the "opt-alpha-0*" options last
+static char* flags[] = {
+    "--opt-alpha-09", "--opt-alpha-05", "--opt-alpha-00", "--opt-alpha-01", "--opt-alpha-07", "--opt-alpha-03",
+    "--opt-alpha-02", "--opt-alpha-08", "--opt-alpha-04", "--opt-alpha-06", "--opt-alpha-09", "--opt-alpha-00",
+};
+static int flagsCount = sizeof(flags) / sizeof(flags[0]);
+
+static long parse10(void) {
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_PARSE_SWITCH(flagsCount, flags) {
+        CAP_LONG_FLAGS(
+            OPTIONS_10("alpha-0")
+        )
+    }
+
+    return hits;
+}
+
+static long parse100(void) {
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_PARSE_SWITCH(flagsCount, flags) {
+        CAP_LONG_FLAGS(
+            OPTIONS_10("bravo-0")
+            OPTIONS_10("foxtrot-0") OPTIONS_10("golf-0") OPTIONS_10("hotel-0") OPTIONS_10("india-0")
+            OPTIONS_10("juliett-0") OPTIONS_10("kilo-0") OPTIONS_10("lima-0") OPTIONS_10("mike-0")
+            OPTIONS_10("alpha-0")
+        )
+    }
+
+    return hits;
+}
+
+static long parse300(void) {
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_PARSE_SWITCH(flagsCount, flags) {
+        CAP_LONG_FLAGS(
+            OPTIONS_10("bravo-0")
+            OPTIONS_100("charlie-")
+            OPTIONS_100("delta-")
+            OPTIONS_10("foxtrot-0") OPTIONS_10("golf-0") OPTIONS_10("hotel-0") OPTIONS_10("india-0")
+            OPTIONS_10("juliett-0") OPTIONS_10("kilo-0") OPTIONS_10("lima-0") OPTIONS_10("mike-0")
+            OPTIONS_10("alpha-0")
+        )
+    }
+
+    return hits;
+}
+
+static char payload[4096 + sizeof("--payload=")];
+static char name[4096 + sizeof("--")];
+
+static long parsePayload(void) {
+    char* argv[] = { payload, "--env=PATH=/usr/bin", name, "--flag" };
+    int argc = sizeof(argv) / sizeof(argv[0]);
+
+    long length = 0;
+
+    for(int i = 0; i < ROUNDS / argc; i++) CAP_FOR_EACH(argc, argv, args, arg) {
+        length += arg.value.longFlag.length;
+    }
+
+    return length;
+}
+
+#define LARGE_ARGC 100000
+
+static char* largeArgv[LARGE_ARGC];
+static signed char largeTypes[LARGE_ARGC * 4];
+static int largeIndexes[LARGE_ARGC * 4];
+static int largeOffsets[LARGE_ARGC * 4];
+static int largeLengths[LARGE_ARGC * 4];
+static int largeAttached[LARGE_ARGC * 4];
+
+static void fillLarge(void) {
+    static char* samples[] = { "-xvzf", "--output=build/out.o", "src/module/file.c", "--verbose", "-o", "include/header.h" };
+
+    for(int i = 0; i < LARGE_ARGC; i++) {
+        largeArgv[i] = samples[i % (sizeof(samples) / sizeof(samples[0]))];
+    }
+}
+
+static long iterateLarge(void) {
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) CAP_FOR_EACH(LARGE_ARGC, largeArgv, args, arg) {
+        count += arg.type;
+    }
+
+    return count;
+}
+
+static long tokenizeLarge(void) {
+    Cap_Tokens tokens = {
+        .capacity = LARGE_ARGC * 4,
+        .types = largeTypes,
+        .indexes = largeIndexes,
+        .offsets = largeOffsets,
+        .lengths = largeLengths,
+        .attached = largeAttached,
+    };
+
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        Cap_Tokenize(LARGE_ARGC, largeArgv, &tokens);
+
+        for(int j = 0; j < tokens.length; j++) {
+            count += tokens.types[j];
+        }
+    }
+
+    return count;
+}
+
+static int cores = 1;
+
+static long tokenizeLargeParallel(void) {
+    Cap_Tokens tokens = {
+        .capacity = LARGE_ARGC * 4,
+        .types = largeTypes,
+        .indexes = largeIndexes,
+        .offsets = largeOffsets,
+        .lengths = largeLengths,
+        .attached = largeAttached,
+    };
+
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        Cap_TokenizeParallel(LARGE_ARGC, largeArgv, &tokens, cores);
+
+        for(int j = 0; j < tokens.length; j++) {
+            count += tokens.types[j];
+        }
+    }
+
+    return count;
+}
+
+// UTF-8 validation as a second pass over the arguments after tokenizing
+static long tokenizeLargeCheck(void) {
+    Cap_Tokens tokens = {
+        .capacity = LARGE_ARGC * 4,
+        .types = largeTypes,
+        .lengths = largeLengths,
+    };
+
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        Cap_Tokenize(LARGE_ARGC, largeArgv, &tokens);
+
+        for(int j = 0; j < LARGE_ARGC; j++) {
+            count += Cap_Utf8Check(largeArgv[j], (int)strlen(largeArgv[j])) < 0;
+        }
+    }
+
+    return count;
+}
+
+static long tokenizeLargeUtf8(void) {
+    Cap_Utf8Error error;
+    Cap_Tokens tokens = {
+        .capacity = LARGE_ARGC * 4,
+        .types = largeTypes,
+        .lengths = largeLengths,
+        .utf8 = &error,
+    };
+
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        Cap_Tokenize(LARGE_ARGC, largeArgv, &tokens);
+        count += error.index < 0 ? LARGE_ARGC : error.index;
+    }
+
+    return count;
+}
+
+static char commandLine[] = "indexer --shards=1024 -vvz --timeout=250ms --output '/var/data/out dir' "
+    "--label=\"nightly \\\"full\\\" run\" src/main.c src/module/file.c src/module/other.c include/header.h -- tail";
+
+static long splitLines(void) {
+    char line[sizeof(commandLine)];
+    char* argv[32];
+
+    long count = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        memcpy(line, commandLine, sizeof(line));
+        count += Cap_Split(line, argv, 32);
+    }
+
+    return count;
+}
+
+// A short-lived worker that keeps the split line and its arguments
+static long splitLinesMalloc(void) {
+    long count = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        char* line = malloc(sizeof(commandLine));
+        char** argv = malloc(sizeof(char*) * 32);
+        memcpy(line, commandLine, sizeof(commandLine));
+
+        count += Cap_Split(line, argv, 32);
+
+        free(argv);
+        free(line);
+    }
+
+    return count;
+}
+
+static long splitLinesArena(void) {
+    char buffer[1024];
+    long count = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        Cap_Arena arena;
+        Cap_ArenaInit(&arena, buffer, sizeof(buffer));
+
+        int argc;
+        Cap_ArenaSplit(&arena, commandLine, &argc);
+        count += argc;
+
+        Cap_ArenaRelease(&arena);
+    }
+
+    return count;
+}
+
+#define CONFIG_ENTRIES 4096
+
+static char configText[CONFIG_ENTRIES * 48];
+static char configWork[sizeof(configText)];
+static size_t configLength = 0;
+
+static void fillConfig(void) {
+    for(int i = 0; i < CONFIG_ENTRIES; i++) {
+        if(i % 64 == 0) configLength += (size_t)sprintf(configText + configLength, "\n# subsystem %d\n[subsystem-%d]\n", i / 64, i / 64);
+
+        configLength += (size_t)sprintf(configText + configLength, "option-%d = value-%d\n", i % 64, i);
+    }
+}
+
+// The usual hand-written parser: a line at a time, the key and the value are copied out
+static long configMalloc(void) {
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        memcpy(configWork, configText, configLength + 1);
+
+        for(char* line = configWork; line;) {
+            char* next = strchr(line, '\n');
+            if(next) *next++ = '\0';
+
+            char* equals = strchr(line, '=');
+
+            if(line[0] != '#' && line[0] != '[' && equals) {
+                char* keyEnd = equals;
+                while(keyEnd > line && keyEnd[-1] == ' ') keyEnd--;
+
+                char* value = equals + 1;
+                while(*value == ' ') value++;
+
+                char* key = malloc((size_t)(keyEnd - line) + 1);
+                memcpy(key, line, (size_t)(keyEnd - line));
+                key[keyEnd - line] = '\0';
+
+                char* copy = malloc(strlen(value) + 1);
+                strcpy(copy, value);
+
+                count += key[0] == 'o';
+
+                free(copy);
+                free(key);
+            }
+
+            line = next;
+        }
+    }
+
+    return count;
+}
+
+static long configNext(void) {
+    long count = 0;
+
+    for(int i = 0; i < 10; i++) {
+        memcpy(configWork, configText, configLength + 1);
+
+        Cap_Config config;
+        Cap_ConfigInit(&config, configWork);
+
+        Cap_Item item;
+        while(Cap_ConfigNext(&config, &item)) count += item.value.longFlag.str[0] == 'o';
+    }
+
+    return count;
+}
+
+static char* bundles[] = { "-xvzf", "archive.tar", "-vvv", "-cz", "-xvf", "-q", "dir", "-nrl" };
+static int bundlesCount = sizeof(bundles) / sizeof(bundles[0]);
+
+static long switchFlags(void) {
+    long verbose = 0, extract = 0, quiet = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) CAP_PARSE_SWITCH(bundlesCount, bundles) {
+        CAP_FLAGS(
+            CAP_MATCH_FLAG('v', { verbose++; })
+            CAP_MATCH_FLAG('x', { extract++; })
+            CAP_MATCH_FLAG('q', { quiet++; })
+        )
+    }
+
+    return verbose + extract + quiet;
+}
+
+static long scanFlags(void) {
+    long verbose = 0, extract = 0, quiet = 0;
+    Cap_FlagSet set;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        Cap_ScanFlags(bundlesCount, bundles, &set);
+
+        verbose += CAP_FLAG_COUNT(&set, 'v');
+        extract += CAP_FLAG_COUNT(&set, 'x');
+        quiet += CAP_FLAG_SEEN(&set, 'q');
+    }
+
+    return verbose + extract + quiet;
+}
+
+#define SUBSYSTEMS 16
+
+static char* subsystemArgv[] = {
+    "--config=prod.toml", "-vv", "--include=src", "--threads=8", "--log-level=debug", "input.dat",
+    "--include=lib", "-o", "out.bin", "--cache-dir=/tmp/cache", "--retries=3", "--include=test", "--dry-run",
+};
+static int subsystemArgc = sizeof(subsystemArgv) / sizeof(subsystemArgv[0]);
+static char* subsystemFlags[SUBSYSTEMS] = {
+    "config", "include", "threads", "log-level", "cache-dir", "retries", "dry-run", "timeout",
+    "config", "include", "threads", "log-level", "cache-dir", "retries", "dry-run", "timeout",
+};
+
+static long walkSubsystems(void) {
+    long found = 0;
+
+    for(int i = 0; i < ROUNDS; i++) {
+        for(int j = 0; j < SUBSYSTEMS; j++) {
+            char* name = subsystemFlags[j];
+            int length = (int)strlen(name);
+
+            CAP_FOR_EACH(subsystemArgc, subsystemArgv, args, arg) {
+                if(arg.type == CAP_LONG_FLAG && arg.value.longFlag.length == length && strncmp(arg.value.longFlag.str, name, (size_t)length) == 0) {
+                    found++;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+static long indexSubsystems(void) {
+    static char* longNames[SUBSYSTEMS];
+    Cap_IndexKey keys[32];
+    Cap_IndexValue values[32];
+    Cap_Index index;
+
+    for(int j = 0; j < SUBSYSTEMS; j++) {
+        static char buffers[SUBSYSTEMS][32];
+        snprintf(buffers[j], sizeof(buffers[j]), "--%s", subsystemFlags[j]);
+        longNames[j] = buffers[j];
+    }
+
+    long found = 0;
+
+    for(int i = 0; i < ROUNDS; i++) {
+        Cap_Iterator iterator;
+        Cap_Init(subsystemArgc, subsystemArgv, &iterator);
+        Cap_IndexInit(&index, &iterator, keys, 32, values, 32);
+
+        for(int j = 0; j < SUBSYSTEMS; j++) {
+            found += Cap_IndexCount(&index, longNames[j]);
+        }
+    }
+
+    return found;
+}
+
+// Synthetic corpora, every run goes through about CORPUS_TOTAL arguments
+#define CORPUS_ARGC 4096
+#define CORPUS_TAIL_ARGC 65536
+#define CORPUS_TOTAL 2000000
+
+static char* bundleCorpus[CORPUS_ARGC];
+static char* valueCorpus[CORPUS_ARGC];
+static char* tailCorpus[CORPUS_TAIL_ARGC];
+static char* lookaheadCorpus[CORPUS_ARGC];
+static char* restCorpus[CORPUS_TAIL_ARGC];
+
+static char corpusPayload[sizeof("--payload=") + 1024];
+static char corpusPaths[CORPUS_TAIL_ARGC][32];
+
+static char** corpus;
+static int corpusArgc;
+
+#define CORPUS_SAMPLES(ARRAY, SAMPLES)\
+    for(int i = 0; i < (int)(sizeof(ARRAY) / sizeof(ARRAY[0])); i++) {\
+        ARRAY[i] = SAMPLES[i % (sizeof(SAMPLES) / sizeof(SAMPLES[0]))];\
+    }
+
+static void fillCorpora(void) {
+    memcpy(corpusPayload, "--payload=", sizeof("--payload=") - 1);
+    memset(corpusPayload + sizeof("--payload=") - 1, 'x', sizeof(corpusPayload) - sizeof("--payload="));
+
+    // Heavy short flag bundles
+    static char* bundles[] = { "-xvzf", "-vvv", "-abcdefgh", "-hx", "-zf", "-v" };
+    CORPUS_SAMPLES(bundleCorpus, bundles);
+
+    // Long flags with 1KB attached values
+    static char* values[] = { corpusPayload, "--output=build/out.o", "--verbose", corpusPayload };
+    CORPUS_SAMPLES(valueCorpus, values);
+
+    // A couple of flags and a huge list of files
+    for(int i = 0; i < CORPUS_TAIL_ARGC; i++) {
+        snprintf(corpusPaths[i], sizeof(corpusPaths[i]), "src/module%d/file%d.c", i / 64, i % 64);
+        tailCorpus[i] = corpusPaths[i];
+    }
+    tailCorpus[0] = "-v";
+    tailCorpus[1] = "--output=build/out.o";
+
+    // The same files after the end of the options
+    memcpy(restCorpus, tailCorpus, sizeof(restCorpus));
+    restCorpus[2] = "--";
+
+    // Every flag takes values from the following arguments
+    static char* lookahead[] = { "file.c", "--include", "src", "lib", "test", "-o", "out.o", "--output", "build/out.o", "-vo", "a.out" };
+    CORPUS_SAMPLES(lookaheadCorpus, lookahead);
+}
+
+static long corpusNext(void) {
+    long count = 0;
+
+    for(int i = 0; i < CORPUS_TOTAL / corpusArgc; i++) CAP_FOR_EACH(corpusArgc, corpus, args, arg) {
+        count += arg.type != CAP_ARG;
+    }
+
+    return count;
+}
+
+static long restNext(void) {
+    long count = 0;
+
+    for(int i = 0; i < CORPUS_TOTAL / CORPUS_TAIL_ARGC; i++) CAP_FOR_EACH(CORPUS_TAIL_ARGC, restCorpus, args, arg) {
+        count += Cap_Length(&arg);
+    }
+
+    return count;
+}
+
+static long restSlice(void) {
+    long count = 0;
+
+    for(int i = 0; i < CORPUS_TOTAL / CORPUS_TAIL_ARGC; i++) CAP_FOR_EACH(CORPUS_TAIL_ARGC, restCorpus, args, arg) {
+        if(!args.optionsEnded) continue;
+
+        // The first file is already read, the rest is taken as it is
+        int restArgc;
+        char** restArgv;
+        Cap_Rest(&args, &restArgc, &restArgv);
+        count += Cap_Length(&arg) + restArgc;
+    }
+
+    return count;
+}
+
+static long corpusSwitch(void) {
+    long hits = 0;
+
+    for(int i = 0; i < CORPUS_TOTAL / corpusArgc; i++) CAP_PARSE_SWITCH(corpusArgc, corpus) {
+        CAP_FLAGS(
+            CAP_MATCH_FLAG('v', { hits++; })
+            CAP_MATCH_FLAG('x', { hits++; })
+            CAP_MATCH_FLAG('z', { hits++; })
+            CAP_MATCH_FLAG('o', {
+                if(Cap_getFlagValue()) hits++;
+            })
+        )
+        CAP_LONG_FLAGS(
+            CAP_MATCH_LFLAG("payload", {
+                if(Cap_getFlagValue()) hits++;
+            })
+            CAP_MATCH_LFLAG("output", {
+                if(Cap_getFlagValue()) hits++;
+            })
+            CAP_MATCH_LFLAG("verbose", { hits++; })
+            CAP_MATCH_LFLAG("include", {
+                while(Cap_getFlagValue()) hits++;
+            })
+        )
+        CAP_ARGS(arg, {
+            hits += arg[0] == 's';
+        })
+    }
+
+    return hits;
+}
+
+static long corpusParse(void) {
+    long count = 0;
+
+    for(int i = 0; i < CORPUS_TOTAL / corpusArgc; i++) {
+        for(int j = 0; j < corpusArgc; j++) {
+            Cap_Item item;
+            Cap_Parse(corpus[j], &item);
+
+            count += item.type != CAP_ARG;
+        }
+    }
+
+    return count;
+}
+
+static struct option getoptOptions[] = {
+    { "payload", required_argument, NULL, 'p' },
+    { "output", required_argument, NULL, 'O' },
+    { "verbose", no_argument, NULL, 'V' },
+    { "include", required_argument, NULL, 'I' },
+    { NULL, 0, NULL, 0 },
+};
+
+static char* getoptArgv[CORPUS_TAIL_ARGC + 1];
+
+static long corpusGetopt(void) {
+    long hits = 0;
+
+    opterr = 0;
+    getoptArgv[0] = "bench";
+
+    for(int i = 0; i < CORPUS_TOTAL / corpusArgc; i++) {
+        // getopt_long() permutes argv, so every round starts from a fresh copy
+        memcpy(getoptArgv + 1, corpus, corpusArgc * sizeof(char*));
+
+#if defined(__GLIBC__)
+        optind = 0;
+#else
+        optind = 1;
+        optreset = 1;
+#endif // __GLIBC__
+
+        int option;
+        while((option = getopt_long(corpusArgc + 1, getoptArgv, "abcdefghvxzo:", getoptOptions, NULL)) != -1) {
+            hits += option != '?';
+        }
+    }
+
+    return hits;
+}
+
+#if defined(CAP_PROC_SCANNER)
+static long processesCount = 0;
+
+static int countTokens(int pid, int argc, char** argv, Cap_Tokens* tokens, void* context) {
+    (void)pid;
+    (void)argc;
+    (void)argv;
+    *(long*)context += tokens->length;
+
+    return 0;
+}
+
+static long scanProcesses(void) {
+    static char buffer[1 << 16];
+    static char* argv[4096];
+    static signed char types[4096];
+    static int indexes[4096];
+
+    Cap_ProcessScanner scanner = {
+        .buffer = buffer,
+        .bufferSize = sizeof(buffer),
+        .argv = argv,
+        .argvCapacity = 4096,
+        .tokens = { .capacity = 4096, .types = types, .indexes = indexes },
+    };
+
+    long tokens = 0;
+    processesCount = 0;
+
+    for(int i = 0; i < 10; i++) {
+        processesCount += Cap_ScanProcesses(&scanner, countTokens, &tokens);
+    }
+
+    return tokens;
+}
+#endif // CAP_PROC_SCANNER
+
+extern char** environ;
+
+#define ENV_OPTIONS 200
+
+static char envNames[ENV_OPTIONS][32];
+static char envFlags[ENV_OPTIONS][32];
+
+// Half of the options are set in the environment
+static void fillEnv(void) {
+    for(int i = 0; i < ENV_OPTIONS; i++) {
+        snprintf(envNames[i], sizeof(envNames[i]), "BENCH_OPTION_%d", i);
+        snprintf(envFlags[i], sizeof(envFlags[i]), "option-%d", i);
+
+        if(i % 2 == 0) setenv(envNames[i], "value", 1);
+    }
+}
+
+static long getenvOptions(void) {
+    long found = 0;
+
+    for(int round = 0; round < 100; round++) {
+        for(int i = 0; i < ENV_OPTIONS; i++) {
+            if(getenv(envNames[i])) found++;
+        }
+    }
+
+    return found;
+}
+
+static long indexOptions(void) {
+    static Cap_EnvEntry entries[1024];
+
+    long found = 0;
+
+    for(int round = 0; round < 100; round++) {
+        Cap_Env env;
+        Cap_EnvInit(&env, "BENCH_", environ, entries, 1024);
+
+        for(int i = 0; i < ENV_OPTIONS; i++) {
+            if(Cap_EnvValue(&env, envFlags[i])) found++;
+        }
+    }
+
+    return found;
+}
+
+// Every option has a default in the config, half of them are overridden by the environment and some by argv
+static Cap_Option mergeOptions[ENV_OPTIONS];
+static Cap_Option* mergeSlots[512];
+static Cap_Spec mergeSpec;
+static char* mergeValues[ENV_OPTIONS];
+static char mergeText[ENV_OPTIONS * 32];
+static char mergeWork[sizeof(mergeText)];
+static size_t mergeLength = 0;
+static char mergeFlags[ENV_OPTIONS / 10][32];
+static char* mergeArgv[ENV_OPTIONS / 10];
+
+static void fillMerge(void) {
+    Cap_SpecInit(&mergeSpec, mergeSlots, 512);
+
+    for(int i = 0; i < ENV_OPTIONS; i++) {
+        mergeOptions[i] = (Cap_Option){ .name = envFlags[i], .hasValue = 1, .destination = mergeValues + i };
+        Cap_SpecAdd(&mergeSpec, mergeOptions + i);
+
+        mergeLength += (size_t)snprintf(mergeText + mergeLength, sizeof(mergeText) - mergeLength, "option-%d = default\n", i);
+    }
+
+    for(int i = 0; i < ENV_OPTIONS / 10; i++) {
+        snprintf(mergeFlags[i], sizeof(mergeFlags[i]), "--option-%d=arg", i * 10);
+        mergeArgv[i] = mergeFlags[i];
+    }
+}
+
+// Every source is parsed and dispatched in full, the later ones overwrite the values
+static long mergeSequential(void) {
+    static Cap_EnvEntry entries[1024];
+
+    long dispatched = 0;
+
+    for(int round = 0; round < 100; round++) {
+        memcpy(mergeWork, mergeText, mergeLength + 1);
+
+        Cap_Config config;
+        Cap_ConfigInit(&config, mergeWork);
+
+        Cap_Iterator defaults;
+        Cap_Init(0, NULL, &defaults);
+        Cap_UseConfig(&defaults, &config);
+
+        Cap_Item item;
+        while(Cap_Next(&defaults, &item)) dispatched += Cap_SpecDispatch(&mergeSpec, &defaults, &item);
+
+        Cap_Env env;
+        Cap_EnvInit(&env, "BENCH_", environ, entries, 1024);
+
+        for(int i = 0; i < ENV_OPTIONS; i++) {
+            if(Cap_EnvItem(&env, envFlags[i], &item)) dispatched += Cap_SpecDispatch(&mergeSpec, NULL, &item);
+        }
+
+        CAP_FOR_EACH(ENV_OPTIONS / 10, mergeArgv, args, arg) {
+            dispatched += Cap_SpecDispatch(&mergeSpec, &args, &arg);
+        }
+    }
+
+    return dispatched;
+}
+
+static long mergeSources(void) {
+    static Cap_EnvEntry entries[1024];
+    unsigned long long bitmaps[CAP_MERGE_WORDS(ENV_OPTIONS)];
+
+    long dispatched = 0;
+
+    for(int round = 0; round < 100; round++) {
+        memcpy(mergeWork, mergeText, mergeLength + 1);
+
+        Cap_Config config;
+        Cap_ConfigInit(&config, mergeWork);
+
+        Cap_Iterator defaults;
+        Cap_Init(0, NULL, &defaults);
+        Cap_UseConfig(&defaults, &config);
+
+        Cap_Env env;
+        Cap_EnvInit(&env, "BENCH_", environ, entries, 1024);
+
+        Cap_Iterator args;
+        Cap_Init(ENV_OPTIONS / 10, mergeArgv, &args);
+
+        Cap_Merge merge;
+        Cap_MergeInit(&merge, &mergeSpec, bitmaps, CAP_MERGE_WORDS(ENV_OPTIONS));
+        Cap_MergeIterator(&merge, &args, 3);
+        Cap_MergeEnv(&merge, &env, 2);
+        Cap_MergeIterator(&merge, &defaults, 1);
+
+        Cap_Item item;
+        while(Cap_MergeNext(&merge, &item)) dispatched += Cap_MergeDispatch(&merge, &item);
+    }
+
+    return dispatched;
+}
+
+#define SPEC_OPTIONS 300
+
+static char specNames[SPEC_OPTIONS][16];
+static Cap_Option specOptions[SPEC_OPTIONS];
+static char* specFlags[12];
+static int specHits = 0;
+
+static long dispatchSpec(void) {
+    static Cap_Option* slots[1024];
+
+    Cap_Spec spec;
+    Cap_SpecInit(&spec, slots, 1024);
+
+    for(int i = 0; i < SPEC_OPTIONS; i++) {
+        snprintf(specNames[i], sizeof(specNames[i]), "opt-%03d", i);
+        specOptions[i] = (Cap_Option){ .name = specNames[i], .destination = &specHits };
+        Cap_SpecAdd(&spec, specOptions + i);
+    }
+
+    static char flags[12][16];
+    for(int i = 0; i < 12; i++) {
+        snprintf(flags[i], sizeof(flags[i]), "--opt-%03d", SPEC_OPTIONS - 1 - i * 7);
+        specFlags[i] = flags[i];
+    }
+
+    for(int i = 0; i < ROUNDS; i++) CAP_FOR_EACH(12, specFlags, args, arg) {
+        Cap_SpecDispatch(&spec, &args, &arg);
+    }
+
+    return specHits;
+}
+
+#define COMMANDS 40
+
+static char commandNames[COMMANDS][16];
+static char* commandArgv[] = { "-v", "status", "--short", "path" };
+static int commandArgc = sizeof(commandArgv) / sizeof(commandArgv[0]);
+
+static int runStatus(Cap_Command* command, Cap_Iterator* iterator, void* context) {
+    (void)command;
+
+    Cap_Item item;
+    while(Cap_Next(iterator, &item)) (*(long*)context)++;
+
+    return 0;
+}
+
+static void fillCommands(void) {
+    for(int i = 0; i < COMMANDS - 1; i++) snprintf(commandNames[i], sizeof(commandNames[i]), "command-%02d", i);
+
+    // The common command is the last one compared
+    strcpy(commandNames[COMMANDS - 1], "status");
+}
+
+static long dispatchCommandsLinear(void) {
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_FOR_EACH(commandArgc, commandArgv, args, arg) {
+        if(arg.type != CAP_ARG) continue;
+
+        for(int j = 0; j < COMMANDS; j++) {
+            if(strcmp(commandNames[j], arg.value.arg) != 0) continue;
+
+            Cap_Iterator child;
+            Cap_Init(args.argc - args.index, args.argv + args.index, &child);
+            runStatus(NULL, &child, &hits);
+            args.index = args.argc;
+            break;
+        }
+    }
+
+    return hits;
+}
+
+static long dispatchCommands(void) {
+    static Cap_Command commands[COMMANDS];
+    static Cap_Command* slots[64];
+
+    Cap_Commands table;
+    Cap_CommandsInit(&table, slots, 64);
+
+    for(int i = 0; i < COMMANDS; i++) {
+        commands[i] = (Cap_Command){ .name = commandNames[i], .handler = runStatus };
+        Cap_CommandsAdd(&table, commands + i);
+    }
+
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_FOR_EACH(commandArgc, commandArgv, args, arg) {
+        Cap_CommandsDispatch(&table, &args, &arg, &hits, NULL);
+    }
+
+    return hits;
+}
+
+static char trieNames[SPEC_OPTIONS][24];
+static char* trieFlags[12];
+
+static void fillTrieNames(void) {
+    static char flags[12][16];
+
+    for(int i = 0; i < SPEC_OPTIONS; i++) snprintf(trieNames[i], sizeof(trieNames[i]), "opt-%03d-setting", i);
+
+    // Abbreviated, but still unique
+    for(int i = 0; i < 12; i++) {
+        snprintf(flags[i], sizeof(flags[i]), "--opt-%03d-s", SPEC_OPTIONS - 1 - i * 7);
+        trieFlags[i] = flags[i];
+    }
+}
+
+static long abbreviationsLinear(void) {
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_FOR_EACH(12, trieFlags, args, arg) {
+        Cap_LongFlag* flag = &arg.value.longFlag;
+        int found = -1;
+        int matches = 0;
+
+        for(int j = 0; j < SPEC_OPTIONS; j++) {
+            if(strncmp(trieNames[j], flag->str, (size_t)flag->length) != 0) continue;
+
+            found = j;
+            matches++;
+
+            if(trieNames[j][flag->length] == '\0') {
+                matches = 1;
+                break;
+            }
+        }
+
+        if(matches == 1) hits += found;
+    }
+
+    return hits;
+}
+
+static long abbreviationsTrie(void) {
+    static Cap_TrieNode nodes[SPEC_OPTIONS * 24];
+
+    Cap_Trie trie;
+    Cap_TrieInit(&trie, nodes, SPEC_OPTIONS * 24);
+
+    for(int i = 0; i < SPEC_OPTIONS; i++) Cap_TrieAdd(&trie, trieNames[i], i);
+
+    long hits = 0;
+
+    for(int i = 0; i < ROUNDS; i++) CAP_FOR_EACH(12, trieFlags, args, arg) {
+        Cap_TrieMatch match;
+
+        if(Cap_TrieFind(&trie, arg.value.longFlag.str, arg.value.longFlag.length, &match) != CAP_TRIE_AMBIGUOUS) {
+            hits += match.id;
+        }
+    }
+
+    return hits;
+}
+
+#define BENCH_OPTIONS(X)\
+    X(FLAG, verbose, 'v', "verbose", 0, "Print more")\
+    X(FLAG, quiet, 'q', "quiet", 0, "Print nothing")\
+    X(INT, jobs, 'j', "jobs", 1, "Number of jobs")\
+    X(INT, retries, 0, "retries", 3, "Number of retries")\
+    X(STRING, output, 'o', "output", NULL, "Output file")\
+    X(STRING, format, 0, "format", "text", "Output format")\
+    X(SIZE, cache, 0, "cache-size", 0, "Cache size")\
+    X(DURATION, timeout, 't', "timeout", 0, "Timeout")
+
+CAP_DEFINE_OPTIONS(BenchOptions, BENCH_OPTIONS)
+
+static char* typedArgv[] = {
+    "-vv", "--jobs=8", "--retries", "5", "-o", "out.bin", "--format=json", "--cache-size=64M", "-t", "250ms", "--quiet"
+};
+static int typedArgc = sizeof(typedArgv) / sizeof(typedArgv[0]);
+
+static long dispatchTypedSpec(void) {
+    static Cap_Option* slots[32];
+
+    long long jobs = 0, retries = 0;
+    unsigned long long cache = 0, timeout = 0;
+    int verbose = 0, quiet = 0;
+    char* jobsValue = NULL;
+    char* retriesValue = NULL;
+    char* output = NULL;
+    char* format = NULL;
+    char* cacheValue = NULL;
+    char* timeoutValue = NULL;
+
+    Cap_Option options[] = {
+        { .name = "verbose", .ch = 'v', .destination = &verbose },
+        { .name = "quiet", .ch = 'q', .destination = &quiet },
+        { .name = "jobs", .ch = 'j', .hasValue = 1, .destination = &jobsValue },
+        { .name = "retries", .hasValue = 1, .destination = &retriesValue },
+        { .name = "output", .ch = 'o', .hasValue = 1, .destination = &output },
+        { .name = "format", .hasValue = 1, .destination = &format },
+        { .name = "cache-size", .hasValue = 1, .destination = &cacheValue },
+        { .name = "timeout", .ch = 't', .hasValue = 1, .destination = &timeoutValue },
+    };
+
+    Cap_Spec spec;
+    Cap_SpecInit(&spec, slots, 32);
+    for(int i = 0; i < (int)(sizeof(options) / sizeof(options[0])); i++) Cap_SpecAdd(&spec, options + i);
+
+    long sum = 0;
+    for(int i = 0; i < ROUNDS; i++) {
+        verbose = quiet = 0;
+
+        CAP_FOR_EACH(typedArgc, typedArgv, args, arg) {
+            Cap_SpecDispatch(&spec, &args, &arg);
+        }
+
+        Cap_ToInt(jobsValue, &jobs);
+        Cap_ToInt(retriesValue, &retries);
+        Cap_ToSize(cacheValue, &cache);
+        Cap_ToDuration(timeoutValue, &timeout);
+
+        sum += jobs + retries + (long)(cache >> 20) + (long)timeout + verbose + quiet + (output != NULL) + (format != NULL);
+    }
+
+    return sum;
+}
+
+static long dispatchTypedOptions(void) {
+    long sum = 0;
+    for(int i = 0; i < ROUNDS; i++) {
+        BenchOptions options;
+        BenchOptions_Init(&options);
+
+        CAP_FOR_EACH(typedArgc, typedArgv, args, arg) {
+            BenchOptions_Dispatch(&options, &args, &arg);
+        }
+
+        sum += options.jobs + options.retries + (long)(options.cache >> 20) + (long)options.timeout
+            + options.verbose + options.quiet + (options.output != NULL) + (options.format != NULL);
+    }
+
+    return sum;
+}
+
+static char* integers[] = { "1024", "-17", "250", "4096", "9223372036854775807", "42", "-1", "65536" };
+static char* reals[] = { "0.5", "3.14159", "-2.75e3", "1e-5", "1024", "0.001", "6.02214076e23", "99.99" };
+
+static long strtollValues(void) {
+    long sum = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        char* end;
+        sum += (long)strtoll(integers[i % 8], &end, 10) & 1;
+    }
+
+    return sum;
+}
+
+static long toIntValues(void) {
+    long sum = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        long long value;
+        if(Cap_ToInt(integers[i % 8], &value) == CAP_VALUE_OK) sum += (long)value & 1;
+    }
+
+    return sum;
+}
+
+static long strtodValues(void) {
+    long sum = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        char* end;
+        sum += strtod(reals[i % 8], &end) > 1;
+    }
+
+    return sum;
+}
+
+static long toDoubleValues(void) {
+    long sum = 0;
+
+    for(int i = 0; i < ROUNDS * 10; i++) {
+        double value;
+        if(Cap_ToDouble(reals[i % 8], &value) == CAP_VALUE_OK) sum += value > 1;
+    }
+
+    return sum;
+}
+
+static int json = 0;
+static int cyclesFd = -1;
+
+// Cycles are counted with perf_event_open() where it is available and allowed
+static void openCycles(void) {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    cyclesFd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif // __linux__
+}
+
+static void startCycles(void) {
+#if defined(__linux__)
+    if(cyclesFd < 0) return;
+
+    ioctl(cyclesFd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(cyclesFd, PERF_EVENT_IOC_ENABLE, 0);
+#endif // __linux__
+}
+
+static long long stopCycles(void) {
+    long long cycles = -1;
+
+#if defined(__linux__)
+    if(cyclesFd < 0) return -1;
+
+    ioctl(cyclesFd, PERF_EVENT_IOC_DISABLE, 0);
+    if(read(cyclesFd, &cycles, sizeof(cycles)) != sizeof(cycles)) cycles = -1;
+#endif // __linux__
+
+    return cycles;
+}
+
+static void report(char* name, double elapsed, long long cycles, double count, long hits) {
+    if(json) {
+        printf("{\"mode\":\"%s\",\"name\":\"%s\",\"ns\":%.3f,\"cycles\":", MODE, name, elapsed / count);
+        if(cycles < 0) {
+            printf("null");
+        } else {
+            printf("%.3f", cycles / count);
+        }
+        printf(",\"result\":%ld}\n", hits);
+    } else if(cycles < 0) {
+        printf("%s %s: %.2f ns/op (%ld)\n", MODE, name, elapsed / count, hits);
+    } else {
+        printf("%s %s: %.2f ns/op, %.2f cycles/op (%ld)\n", MODE, name, elapsed / count, cycles / count, hits);
+    }
+}
+
+typedef long Bench(void);
+
+static void run(char* name, Bench* bench, double count) {
+    startCycles();
+    double start = now();
+    long hits = bench();
+    double elapsed = now() - start;
+    long long cycles = stopCycles();
+
+    report(name, elapsed, cycles, count, hits);
+}
+
+static void runCorpus(char* corpusName, char** args, int argc) {
+    corpus = args;
+    corpusArgc = argc;
+
+    double count = (double)(CORPUS_TOTAL / argc) * argc;
+    char name[128];
+
+    snprintf(name, sizeof(name), "%s, Cap_Next", corpusName);
+    run(name, corpusNext, count);
+    snprintf(name, sizeof(name), "%s, CAP_PARSE_SWITCH", corpusName);
+    run(name, corpusSwitch, count);
+    snprintf(name, sizeof(name), "%s, Cap_Parse", corpusName);
+    run(name, corpusParse, count);
+    snprintf(name, sizeof(name), "%s, getopt_long", corpusName);
+    run(name, corpusGetopt, count);
+}
+
+int main(int argc, char** argv) {
+    CAP_PARSE_SWITCH(argc - 1, argv + 1) {
+        CAP_LONG_FLAGS(
+            CAP_MATCH_LFLAG("json", {
+                json = 1;
+            })
+            CAP_UNMATCHED_LFLAGS(flag, {
+                fprintf(stderr, "Unknown flag --%.*s\n", flag->length, flag->str);
+                return 1;
+            })
+        )
+    }
+
+    openCycles();
+
+    fillCorpora();
+    runCorpus("corpus short flag bundles", bundleCorpus, CORPUS_ARGC);
+    runCorpus("corpus 1KB long flag values", valueCorpus, CORPUS_ARGC);
+    runCorpus("corpus 64k positional tail", tailCorpus, CORPUS_TAIL_ARGC);
+    runCorpus("corpus value lookahead", lookaheadCorpus, CORPUS_ARGC);
+    run("corpus 64k tail after --, Cap_Next", restNext, (double)(CORPUS_TOTAL / CORPUS_TAIL_ARGC) * CORPUS_TAIL_ARGC);
+    run("corpus 64k tail after --, Cap_Rest", restSlice, (double)(CORPUS_TOTAL / CORPUS_TAIL_ARGC) * CORPUS_TAIL_ARGC);
+
+    run("long flags, 10 options", parse10, (double)ROUNDS * flagsCount);
+    run("long flags, 100 options", parse100, (double)ROUNDS * flagsCount);
+    run("long flags, 300 options", parse300, (double)ROUNDS * flagsCount);
+
+    memcpy(payload, "--payload=", sizeof("--payload=") - 1);
+    memset(payload + sizeof("--payload=") - 1, 'x', sizeof(payload) - sizeof("--payload="));
+    memset(name, 'x', sizeof(name) - 1);
+    name[0] = name[1] = '-';
+    run("long flags, 4KB values and names", parsePayload, ROUNDS);
+
+    fillLarge();
+    run("100k args, Cap_Next", iterateLarge, LARGE_ARGC * 10.0);
+    run("100k args, Cap_Tokenize", tokenizeLarge, LARGE_ARGC * 10.0);
+
+    cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char parallelName[64];
+    snprintf(parallelName, sizeof(parallelName), "100k args, Cap_TokenizeParallel, %d threads", cores);
+    run(parallelName, tokenizeLargeParallel, LARGE_ARGC * 10.0);
+    run("100k args, Cap_Tokenize + Cap_Utf8Check pass", tokenizeLargeCheck, LARGE_ARGC * 10.0);
+    run("100k args, Cap_Tokenize with UTF-8 validation", tokenizeLargeUtf8, LARGE_ARGC * 10.0);
+
+    run("command line, Cap_Split", splitLines, ROUNDS * 10.0);
+    run("command line, malloc + Cap_Split", splitLinesMalloc, ROUNDS * 10.0);
+    run("command line, Cap_ArenaSplit", splitLinesArena, ROUNDS * 10.0);
+
+    fillConfig();
+    run("config 4k entries, strchr + malloc per entry", configMalloc, CONFIG_ENTRIES * 10.0);
+    run("config 4k entries, Cap_ConfigNext", configNext, CONFIG_ENTRIES * 10.0);
+
+    run("short flag bundles, Cap_Next", switchFlags, ROUNDS * 10.0 * bundlesCount);
+    run("short flag bundles, Cap_ScanFlags", scanFlags, ROUNDS * 10.0 * bundlesCount);
+
+    run("16 subsystems, CAP_FOR_EACH each", walkSubsystems, ROUNDS * (double)SUBSYSTEMS);
+    run("16 subsystems, Cap_IndexInit + Cap_IndexCount", indexSubsystems, ROUNDS * (double)SUBSYSTEMS);
+
+    run("long flags, 300 runtime options, Cap_SpecDispatch", dispatchSpec, ROUNDS * 12.0);
+    fillCommands();
+    run("40 subcommands, strcmp + Cap_Init", dispatchCommandsLinear, ROUNDS * (double)commandArgc);
+    run("40 subcommands, Cap_CommandsDispatch", dispatchCommands, ROUNDS * (double)commandArgc);
+
+    fillTrieNames();
+    run("300 abbreviated long flags, prefix compare", abbreviationsLinear, ROUNDS * 12.0);
+    run("300 abbreviated long flags, Cap_TrieFind", abbreviationsTrie, ROUNDS * 12.0);
+
+    run("8 typed options, Cap_SpecDispatch + Cap_To*", dispatchTypedSpec, ROUNDS * (double)typedArgc);
+    run("8 typed options, CAP_DEFINE_OPTIONS", dispatchTypedOptions, ROUNDS * (double)typedArgc);
+
+    run("integers, strtoll", strtollValues, ROUNDS * 10.0);
+    run("integers, Cap_ToInt", toIntValues, ROUNDS * 10.0);
+    run("reals, strtod", strtodValues, ROUNDS * 10.0);
+    run("reals, Cap_ToDouble", toDoubleValues, ROUNDS * 10.0);
+
+    fillEnv();
+    run("200 options, getenv", getenvOptions, 100.0 * ENV_OPTIONS);
+    run("200 options, Cap_EnvInit + Cap_EnvValue", indexOptions, 100.0 * ENV_OPTIONS);
+
+    fillMerge();
+    run("200 options from config, env and argv, a full pass each", mergeSequential, 100.0 * ENV_OPTIONS);
+    run("200 options from config, env and argv, Cap_Merge", mergeSources, 100.0 * ENV_OPTIONS);
+
+#if defined(CAP_PROC_SCANNER)
+    // The number of processes is known only after the sweep, so the time is divided here
+    startCycles();
+    double start = now();
+    long tokens = scanProcesses();
+    double elapsed = now() - start;
+    report("/proc sweep, Cap_ScanProcesses, per process", elapsed, stopCycles(), (double)processesCount, tokens);
+#endif // CAP_PROC_SCANNER
+
+    return 0;
+}
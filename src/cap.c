@@ -1,136 +1,2732 @@
 #include "cap.h"
 
 #include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <float.h>
+#include <limits.h>
+
+#if defined(CAP_RESPONSE_FILES) || defined(CAP_CONFIG_FILES)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+
+    #if !defined(MAP_ANONYMOUS)
+        #define MAP_ANONYMOUS MAP_ANON
+    #endif // MAP_ANONYMOUS
+#endif // CAP_RESPONSE_FILES || CAP_CONFIG_FILES
+
+// USDT probes for bpftrace/SystemTap, the header comes with systemtap-sdt-dev
+#if defined(CAP_USDT)
+    #include <sys/sdt.h>
+
+    #define CAP_INTERNAL_PROBE(NAME, A, B) DTRACE_PROBE2(cap, NAME, A, B)
+#else
+    #define CAP_INTERNAL_PROBE(NAME, A, B) ((void)0)
+#endif // CAP_USDT
+
+#if defined(CAP_ARENA)
+    #include <stdint.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+    #if !defined(MAP_ANONYMOUS)
+        #define MAP_ANONYMOUS MAP_ANON
+    #endif // MAP_ANONYMOUS
+#endif // CAP_ARENA
+
+// UTF-8 validation uses the AVX2 lookup when the compiler targets it. GCC and Clang also build it for other
+// x86 targets and pick it at run time, elsewhere -mavx2 or -march=native enable it
+#if defined(__AVX2__)
+    #include <immintrin.h>
+
+    #define CAP_INTERNAL_UTF8_AVX2
+    #define CAP_INTERNAL_TARGET_AVX2
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+
+    #define CAP_INTERNAL_UTF8_AVX2
+    #define CAP_INTERNAL_UTF8_DISPATCH
+    #define CAP_INTERNAL_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif // __AVX2__
+
+#if defined(CAP_PARALLEL_TOKENIZE)
+    #include <pthread.h>
+#endif // CAP_PARALLEL_TOKENIZE
+
+#if defined(CAP_PROC_SCANNER)
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif // CAP_PROC_SCANNER
 
 void Cap_Init(int argc, char** argv, struct Cap_Iterator* iterator) {
     iterator->argc = argc;
     iterator->argv = argv;
     iterator->index = 0;
     iterator->mergedFlagsCursor = NULL;
+    iterator->mergedFlagsBase = NULL;
+    iterator->lookaheadStart = 0;
+    iterator->lookaheadCount = 0;
+    iterator->optionsEnded = 0;
+    iterator->afterTerminator = NULL;
+#if defined(CAP_RESPONSE_FILES)
+    iterator->filesCount = 0;
+    iterator->currentFile = -1;
+    iterator->mappings = NULL;
+#if defined(CAP_ARENA)
+    iterator->arena = NULL;
+#endif // CAP_ARENA
+#endif // CAP_RESPONSE_FILES
+#if defined(CAP_CONFIG_FILES)
+    iterator->config = NULL;
+    iterator->configIndex = 0;
+#endif // CAP_CONFIG_FILES
+#if defined(CAP_STATS)
+    memset(&iterator->stats, 0, sizeof(iterator->stats));
+    iterator->trace = NULL;
+    iterator->traceContext = NULL;
+#endif // CAP_STATS
 }
 
-void CapInternalParse(char* arg, Cap_Item* result, Cap_Iterator* iterator) {
-    if(arg[0] == '-') {
-        char* cursor = arg + 1;
-        char ch;
-        if(arg[1] == '-') {
-            cursor = cursor + 1;
-
-            if(result) {
-                result->type = CAP_LONG_FLAG;
-                result->value.longFlag.str = arg + 2;
-                result->value.longFlag.length = 0;
-                result->value.longFlag.terminated = 1;
-                result->value.longFlag.attached = NULL;
-            }
+void Cap_Release(Cap_Iterator* iterator) {
+#if defined(CAP_RESPONSE_FILES)
+    // Files read into an arena have no mapped size and are released with the arena
+    for(int i = 0; i < iterator->filesCount; i++) {
+        if(iterator->files[i].size) munmap(iterator->files[i].data, iterator->files[i].size);
+    }
+
+    while(iterator->mappings) {
+        Cap_ResponseMapping* mapping = iterator->mappings;
+        iterator->mappings = mapping->previous;
+        munmap((char*)(mapping + 1) - mapping->size, mapping->size);
+    }
+
+    iterator->filesCount = 0;
+    iterator->currentFile = -1;
+#else
+    (void)iterator;
+#endif // CAP_RESPONSE_FILES
+}
+
+void CapInternalMove(char* to, char* from, size_t length) {
+    if(to == from) return;
+
+    for(size_t i = 0; i < length; i++) to[i] = from[i];
+}
+
+char* CapInternalSplit(char** cursor) {
+    char* in = *cursor;
+
+    // A backslash before a newline joins the lines, so between the arguments it is whitespace too
+    while(*in == ' ' || (*in >= '\t' && *in <= '\r') || (in[0] == '\\' && in[1] == '\n')) in++;
+
+    if(!*in) {
+        *cursor = in;
+        return NULL;
+    }
+
+    // The token is unquoted in place, the output never gets ahead of the input.
+    // Plain chars are skipped with strcspn() and only moved once quotes or escapes have shifted the output.
+    char* token = in;
+    char* out = in;
+
+    for(;;) {
+        size_t length = CAP_STR_CSPN(in, " \t\n\v\f\r'\"\\");
+        CapInternalMove(out, in, length);
+        out += length;
+        in += length;
+
+        char ch = *in;
+
+        if(ch == '\'') {
+            in++;
+            length = CAP_STR_CSPN(in, "'");
+            CapInternalMove(out, in, length);
+            out += length;
+            in += length;
+
+            if(*in) in++;
+        } else if(ch == '"') {
+            in++;
+
+            for(;;) {
+                length = CAP_STR_CSPN(in, "\"\\");
+                CapInternalMove(out, in, length);
+                out += length;
+                in += length;
 
-            while((ch = *cursor++)) {
-                if(ch == '=') {
-                    if(result) {
-                        result->value.longFlag.terminated = 0;
-                        if(cursor[0]) {
-                            result->value.longFlag.attached = cursor;
-                        }
+                if(*in == '\\') {
+                    // Only the chars the shell treats specially in double quotes are escaped
+                    char next = in[1];
+
+                    if(next == '\n') {
+                        in += 2;
+                        continue;
                     }
 
+                    if(next == '"' || next == '\\' || next == '$' || next == '`') in++;
+                    *out++ = *in++;
+                } else {
+                    if(*in) in++;
                     break;
-                } else if(result) {
-                    result->value.longFlag.length += 1;
                 }
             }
+        } else if(ch == '\\') {
+            in++;
+
+            if(*in == '\n') in++;
+            else if(*in) *out++ = *in++;
         } else {
-            char ch = cursor[0];
+            // Whitespace or the end of the string
+            if(ch) in++;
+            break;
+        }
+    }
+
+    *cursor = in;
+    *out = '\0';
+
+    return token;
+}
+
+int Cap_Split(char* line, char** argv, int capacity) {
+    int argc = 0;
+
+    for(char* arg; (arg = CapInternalSplit(&line));) {
+        if(argc >= capacity) return -1;
+
+        argv[argc++] = arg;
+    }
+
+    return argc;
+}
+
+#if defined(CAP_RESPONSE_FILES) || defined(CAP_CONFIG_FILES)
+
+// The file is mapped over a zeroed anonymous region that is at least tail + 1 bytes longer,
+// so the last token is always followed by '\0'. Private mapping keeps the file intact
+// while the tokens are terminated in place.
+char* CapInternalMapFile(int fd, size_t size, size_t tail, size_t* mappedSize) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *mappedSize = ((size + tail) / page + 1) * page;
+
+    char* data = mmap(NULL, *mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED) return NULL;
+
+    if(size > 0 && mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(data, *mappedSize);
+        return NULL;
+    }
+
+    return data;
+}
+
+#endif // CAP_RESPONSE_FILES || CAP_CONFIG_FILES
+
+#if defined(CAP_RESPONSE_FILES)
+
+#if defined(CAP_ARENA)
+
+// Small files are cheaper to read than to map, and the arena takes the place of the two mappings.
+// The big ones would get a mapped chunk of their own anyway, so they are mapped straight from the file.
+char* CapInternalReadResponseFile(Cap_Arena* arena, int fd, size_t size) {
+    char* data = Cap_ArenaAlloc(arena, size + 1);
+    if(!data) return NULL;
+
+    size_t done = 0;
+
+    while(done < size) {
+        ssize_t count = read(fd, data + done, size - done);
+        if(count <= 0) break;
+
+        done += (size_t)count;
+    }
+
+    data[done] = '\0';
+
+    return data;
+}
+
+void Cap_UseArena(Cap_Iterator* iterator, Cap_Arena* arena) {
+    iterator->arena = arena;
+}
+
+#endif // CAP_ARENA
+
+int CapInternalOpenResponseFile(Cap_Iterator* iterator, char* path) {
+    if(iterator->filesCount >= CAP_RESPONSE_FILES_MAX) return 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+
+    struct stat info;
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    // Files that include themselves are taken literally
+    for(int i = iterator->currentFile; i >= 0; i = iterator->files[i].parent) {
+        if(iterator->files[i].device == (unsigned long long)info.st_dev && iterator->files[i].inode == (unsigned long long)info.st_ino) {
+            close(fd);
+            return 0;
+        }
+    }
+
+    size_t size = (size_t)info.st_size;
+    size_t mappedSize = 0;
+
+#if defined(CAP_ARENA)
+    char* data = iterator->arena && size < CAP_ARENA_CHUNK_SIZE / 4
+        ? CapInternalReadResponseFile(iterator->arena, fd, size)
+        : CapInternalMapFile(fd, size, sizeof(Cap_ResponseMapping), &mappedSize);
+#else
+    char* data = CapInternalMapFile(fd, size, sizeof(Cap_ResponseMapping), &mappedSize);
+#endif // CAP_ARENA
+
+    close(fd);
+
+    if(!data) return 0;
+
+    // The @file argument itself is consumed
+    if(iterator->currentFile >= 0) iterator->files[iterator->currentFile].next = NULL;
+    else iterator->index++;
+
+    Cap_ResponseFile* file = iterator->files + iterator->filesCount;
+    file->data = data;
+    file->size = mappedSize;
+    file->cursor = data;
+    file->next = NULL;
+    file->parent = iterator->currentFile;
+    file->device = (unsigned long long)info.st_dev;
+    file->inode = (unsigned long long)info.st_ino;
+
+    iterator->currentFile = iterator->filesCount++;
+
+    return 1;
+}
+
+// The returned strings point into the file, so only the slot is given back and the mapping is kept for Cap_Release()
+void CapInternalCloseResponseFile(Cap_Iterator* iterator) {
+    Cap_ResponseFile* file = iterator->files + --iterator->filesCount;
+    if(!file->size) return;
+
+    Cap_ResponseMapping* mapping = (Cap_ResponseMapping*)(file->data + file->size) - 1;
+    mapping->previous = iterator->mappings;
+    mapping->size = file->size;
+    iterator->mappings = mapping;
+}
+
+char* CapInternalPeekArg(Cap_Iterator* iterator) {
+    for(;;) {
+        char* arg;
+
+        if(iterator->currentFile >= 0) {
+            Cap_ResponseFile* file = iterator->files + iterator->currentFile;
+
+            if(!file->next) file->next = CapInternalSplit(&file->cursor);
+
+            if(!file->next) {
+                iterator->currentFile = file->parent;
+                CapInternalCloseResponseFile(iterator);
+                continue;
+            }
+
+            arg = file->next;
+        } else if(iterator->index < iterator->argc) {
+            arg = iterator->argv[iterator->index];
+        } else {
+            return NULL;
+        }
+
+        // After "--" an @path is a plain argument, just like in the tail Cap_Rest() returns
+        if(arg[0] != '@' || iterator->optionsEnded || !CapInternalOpenResponseFile(iterator, arg + 1)) return arg;
+    }
+}
+
+void CapInternalConsumeArg(Cap_Iterator* iterator) {
+    if(iterator->currentFile >= 0) iterator->files[iterator->currentFile].next = NULL;
+    else iterator->index++;
+}
+
+// Arguments from response files are located by the index of the @file argument and the offset in the file
+char* CapInternalArgBase(Cap_Iterator* iterator, char* arg) {
+    return iterator->currentFile >= 0 ? iterator->files[iterator->currentFile].data : arg;
+}
+
+#else
+
+char* CapInternalPeekArg(Cap_Iterator* iterator) {
+    return iterator->index < iterator->argc ? iterator->argv[iterator->index] : NULL;
+}
+
+void CapInternalConsumeArg(Cap_Iterator* iterator) {
+    iterator->index++;
+}
+
+char* CapInternalArgBase(Cap_Iterator* iterator, char* arg) {
+    (void)iterator;
+    return arg;
+}
+
+#endif // CAP_RESPONSE_FILES
+
+#if defined(CAP_CONFIG_FILES)
+
+void Cap_ConfigInit(Cap_Config* config, char* text) {
+    config->data = text;
+    config->size = 0;
+    config->cursor = text;
+    config->section = NULL;
+    config->line = 0;
+}
+
+int Cap_ConfigOpen(Cap_Config* config, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+
+    struct stat info;
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    size_t mappedSize = 0;
+    char* data = CapInternalMapFile(fd, (size_t)info.st_size, 0, &mappedSize);
+
+    close(fd);
+
+    if(!data) return 0;
+
+    Cap_ConfigInit(config, data);
+    config->size = mappedSize;
+
+    return 1;
+}
+
+void Cap_ConfigRelease(Cap_Config* config) {
+    if(config->size) munmap(config->data, config->size);
+
+    config->data = NULL;
+    config->size = 0;
+    config->cursor = NULL;
+    config->section = NULL;
+}
 
-            if(result) {
-                result->type = CAP_FLAG;
-                result->value.flag.ch = ch;
-                result->value.flag.attached = NULL;
+#define CAP_INTERNAL_CONFIG_SPACE(CH) ((CH) == ' ' || (CH) == '\t' || (CH) == '\r')
+
+// Drops the whitespace around [from, *to) and terminates it in place, returns the new start
+char* CapInternalConfigTrim(char* from, char** to) {
+    char* end = *to;
+
+    while(from < end && CAP_INTERNAL_CONFIG_SPACE(*from)) from++;
+    while(end > from && CAP_INTERNAL_CONFIG_SPACE(end[-1])) end--;
+
+    *end = '\0';
+    *to = end;
+
+    return from;
+}
+
+// Every line is scanned once: the end of the key or of the line is found first and the value is
+// the rest of the line. Keys and values are terminated right in the text, nothing is copied.
+int Cap_ConfigNext(Cap_Config* config, Cap_Item* item) {
+    char* cursor = config->cursor;
+
+    for(;;) {
+        while(CAP_INTERNAL_CONFIG_SPACE(*cursor)) cursor++;
+
+        if(!*cursor) {
+            config->cursor = cursor;
+            item->type = CAP_NONE;
+            return 0;
+        }
+
+        config->line++;
+
+        char* start = cursor;
+        char* end;
+
+        switch(*start) {
+            case '\n':
+                cursor++;
+                continue;
+
+            case '#':
+            case ';':
+                cursor += CAP_STR_CSPN(cursor, "\n");
+                if(*cursor) cursor++;
+                continue;
+
+            case '[':
+                end = start + CAP_STR_CSPN(start, "]\n");
+                cursor = *end == ']' ? end + CAP_STR_CSPN(end, "\n") : end;
+                if(*cursor) cursor++;
+
+                config->section = CapInternalConfigTrim(start + 1, &end);
+                continue;
+        }
+
+        // strcspn() is vectorized by libc, so the lines are scanned in blocks instead of byte by byte
+        end = start + CAP_STR_CSPN(start, "=\n");
+
+        char* value = NULL;
+        char* valueEnd = end;
+
+        if(*end == '=') {
+            value = end + 1;
+            valueEnd = value + CAP_STR_CSPN(value, "\n");
+        }
+
+        cursor = *valueEnd ? valueEnd + 1 : valueEnd;
+
+        if(value) {
+            value = CapInternalConfigTrim(value, &valueEnd);
+
+            // Quotes keep the whitespace around the value, there are no escapes inside of them
+            if(valueEnd - value >= 2 && (value[0] == '"' || value[0] == '\'') && valueEnd[-1] == value[0]) {
+                *--valueEnd = '\0';
+                value++;
+            }
+        }
+
+        char* key = CapInternalConfigTrim(start, &end);
+        if(end == key) continue;
+
+        item->type = CAP_LONG_FLAG;
+        item->value.longFlag.str = key;
+        item->value.longFlag.length = (int)(end - key);
+        item->value.longFlag.terminated = 1;
+        item->value.longFlag.attached = NULL;
+        item->length = item->value.longFlag.length;
+        item->attachedLength = 0;
+        item->index = -1;
+        item->offset = (int)(key - config->data);
+
+        if(value && value[0]) {
+            item->value.attached = value;
+            item->attachedLength = (int)(valueEnd - value);
+        }
+
+        config->cursor = cursor;
+
+        return 1;
+    }
+}
+
+// The arguments are hidden until the config is over, so the common path of the iterator doesn't check for it
+void Cap_UseConfig(Cap_Iterator* iterator, Cap_Config* config) {
+    iterator->config = config;
+    iterator->configIndex = iterator->index;
+    iterator->index = iterator->argc;
+}
+
+#endif // CAP_CONFIG_FILES
+
+// The parser doesn't read attached values, Cap_ValueView() measures them once their length is asked for
+void CapInternalAttach(Cap_Item* item, char* attached) {
+    item->value.attached = attached;
+    item->attachedLength = -1;
+}
+
+// "--" sets optionsEnded and returns 0 instead of an item, without optionsEnded it is a long flag with an empty name
+int CapInternalParse(char* arg, Cap_Item* result, char** mergedFlagsCursor, int* optionsEnded) {
+    if(arg[0] == '-' && !(optionsEnded && *optionsEnded)) {
+        char* cursor = arg + 1;
+        if(arg[1] == '-') {
+            char* str = arg + 2;
+
+            if(!str[0] && optionsEnded) {
+                *optionsEnded = 1;
+                return 0;
+            }
+
+            // strcspn() is vectorized by libc, so the name is scanned in blocks instead of byte by byte
+            int length = (int)CAP_STR_CSPN(str, "=");
+
+            result->type = CAP_LONG_FLAG;
+            result->value.longFlag.str = str;
+            result->value.longFlag.length = length;
+            result->value.longFlag.terminated = str[length] == '\0';
+            result->value.longFlag.attached = NULL;
+            result->length = length;
+            result->attachedLength = 0;
+            result->offset = 2;
+
+            if(str[length] && str[length + 1]) {
+                CapInternalAttach(result, str + length + 1);
             }
+        } else {
+            char ch = cursor[0];
+
+            result->type = CAP_FLAG;
+            result->value.flag.ch = ch;
+            result->value.flag.attached = NULL;
+            result->length = 1;
+            result->attachedLength = 0;
+            result->offset = 1;
 
-            switch(cursor[1]) {
+            switch(ch ? cursor[1] : '\0') {
                 case '\0':
                     break;
                 
                 case '=':
-                    if(cursor[2] && result) {
-                        result->value.flag.attached = cursor + 2;
+                    if(cursor[2]) {
+                        CapInternalAttach(result, cursor + 2);
                     }
 
                     break;
                 
                 default: 
-                    if(iterator) iterator->mergedFlagsCursor = cursor + 1;
+                    if(mergedFlagsCursor) *mergedFlagsCursor = cursor + 1;
             }
         }
-    } else if(result) {
+    } else {
         result->type = CAP_ARG;
         result->value.arg = arg;
+        result->length = -1; // measured by Cap_Length()
+        result->attachedLength = 0;
+        result->offset = 0;
+    }
+
+    return 1;
+}
+
+// base is the string the flags belong to, the offset of the item is counted from it
+void CapInternalReadMerged(char** mergedFlagsCursor, char* base, Cap_Item* item) {
+    char* cursor = *mergedFlagsCursor;
+
+    item->type = CAP_FLAG;
+    item->value.flag.ch = cursor[0];
+    item->value.flag.attached = NULL;
+    item->length = 1;
+    item->attachedLength = 0;
+    item->offset = (int)(cursor - base);
+
+    char next = cursor[1];
+    *mergedFlagsCursor = next && next != '=' ? cursor + 1 : NULL;
+
+    if(next == '=' && cursor[2]) CapInternalAttach(item, cursor + 2);
+}
+
+#if defined(CAP_STATS)
+
+void Cap_Trace(Cap_Iterator* iterator, Cap_TraceHook* hook, void* context) {
+    iterator->trace = hook;
+    iterator->traceContext = context;
+}
+
+void CapInternalTrace(Cap_Iterator* iterator, Cap_Item* item, int isDry) {
+    if(isDry) {
+        iterator->stats.checks++;
+    } else {
+        iterator->stats.items++;
+    }
+
+    if(iterator->trace) iterator->trace(iterator, item, isDry, iterator->traceContext);
+}
+
+#define CAP_INTERNAL_TRACE(ITERATOR, ITEM, IS_DRY) CapInternalTrace(ITERATOR, ITEM, IS_DRY)
+
+#else
+
+#define CAP_INTERNAL_TRACE(ITERATOR, ITEM, IS_DRY) ((void)0)
+
+#endif // CAP_STATS
+
+// The terminator itself is not an item, the first argument after it is read instead
+int CapInternalEndOptions(Cap_Iterator* iterator, Cap_Item* item) {
+    char* arg = CapInternalPeekArg(iterator);
+
+    if(!arg) {
+        item->type = CAP_NONE;
+        return 0;
     }
 
-    if(iterator) iterator->index++;
+    char* base = CapInternalArgBase(iterator, arg);
+
+    CapInternalParse(arg, item, NULL, &iterator->optionsEnded);
+    CapInternalConsumeArg(iterator);
+
+    iterator->afterTerminator = arg;
+
+    item->index = iterator->index - 1;
+    item->offset = (int)(arg - base);
+
+    return 1;
 }
 
-int CapInternalRead(Cap_Iterator* iterator, Cap_Item* item, int isDry) {
+// Parses and consumes the next argument, the lookahead is handled by the callers
+int CapInternalRead(Cap_Iterator* iterator, Cap_Item* item) {
     if(iterator->mergedFlagsCursor) {
-        char nextChar = iterator->mergedFlagsCursor[0];
-        if(item) {
-            item->type = CAP_FLAG;
-            item->value.flag.ch = nextChar;
-            item->value.flag.attached = NULL;
-        }
+        CAP_INTERNAL_STAT(iterator, merged);
+        CAP_INTERNAL_PROBE(merged, iterator->mergedFlagsCursor, iterator->index);
 
-        switch(iterator->mergedFlagsCursor[1]) {
-            case '\0':
-                if(!isDry) iterator->mergedFlagsCursor = NULL;
-                break;
-            
-            case '=':
-                if(iterator->mergedFlagsCursor[2]) {
-                    item->value.flag.attached = iterator->mergedFlagsCursor + 2;
-                }
-                if(!isDry) iterator->mergedFlagsCursor = NULL;
-                break;
-            
-            default:
-                if(!isDry) iterator->mergedFlagsCursor = iterator->mergedFlagsCursor + 1;
-        }
+        CapInternalReadMerged(&iterator->mergedFlagsCursor, iterator->mergedFlagsBase, item);
+        item->index = iterator->index - 1;
 
         return 1;
     }
 
-    if(iterator->index >= iterator->argc) {
+    char* arg = CapInternalPeekArg(iterator);
+
+    if(!arg) {
         item->type = CAP_NONE;
         return 0;
     }
 
-    CapInternalParse(iterator->argv[iterator->index], item, isDry ? NULL : iterator);
+    CAP_INTERNAL_STAT(iterator, parses);
+    CAP_INTERNAL_PROBE(parse, arg, iterator->index);
+
+    char* base = CapInternalArgBase(iterator, arg);
+
+    int parsed = CapInternalParse(arg, item, &iterator->mergedFlagsCursor, &iterator->optionsEnded);
+    CapInternalConsumeArg(iterator);
+
+    if(!parsed) return CapInternalEndOptions(iterator, item);
+
+    // The argument is consumed, so its index is the previous one, the @file one for response files
+    item->index = iterator->index - 1;
+    item->offset += (int)(arg - base);
+    iterator->mergedFlagsBase = base;
 
     return 1;
 }
 
-int Cap_Next(Cap_Iterator* iterator, Cap_Item* item) {
-    return CapInternalRead(iterator, item, 0);
+#if defined(CAP_CONFIG_FILES)
+
+// Called when the arguments are over, which they seem to be while the config is read
+int CapInternalReadConfig(Cap_Iterator* iterator, Cap_Item* item) {
+    if(!iterator->config) return 0;
+    if(Cap_ConfigNext(iterator->config, item)) return 1;
+
+    iterator->config = NULL;
+    iterator->index = iterator->configIndex;
+
+    return CapInternalRead(iterator, item);
 }
 
-int Cap_Check(Cap_Iterator* iterator, Cap_Item* item) {
-    return CapInternalRead(iterator, item, 1);
+#define CAP_INTERNAL_READ_CONFIG(ITERATOR, ITEM) CapInternalReadConfig(ITERATOR, ITEM)
+
+#else
+
+#define CAP_INTERNAL_READ_CONFIG(ITERATOR, ITEM) 0
+
+#endif // CAP_CONFIG_FILES
+
+// Takes the oldest peeked item
+int CapInternalTakePeeked(Cap_Iterator* iterator, Cap_Item* item) {
+    Cap_Item* peeked = iterator->lookahead + iterator->lookaheadStart;
+    if(item) *item = *peeked;
+
+    // The caller may skip the item with NULL, the hook still sees it
+    CAP_INTERNAL_TRACE(iterator, peeked, 0);
+
+    iterator->lookaheadStart = (iterator->lookaheadStart + 1) % CAP_LOOKAHEAD_SIZE;
+    iterator->lookaheadCount--;
+
+    return 1;
 }
 
-char* Cap_Value(Cap_Iterator* iterator, Cap_Item* item) {
-    if(item->type == CAP_ARG) return NULL;
+// Skipped items are still parsed to find where the next one starts
+int CapInternalSkip(Cap_Iterator* iterator) {
+    Cap_Item item;
+    return Cap_Next(iterator, &item);
+}
+
+int Cap_Next(Cap_Iterator* iterator, Cap_Item* item) {
+    if(iterator->lookaheadCount > 0) return CapInternalTakePeeked(iterator, item);
+    if(!item) return CapInternalSkip(iterator);
 
-    if(item->value.attached) return item->value.attached;
+    if(!CapInternalRead(iterator, item) && !CAP_INTERNAL_READ_CONFIG(iterator, item)) return 0;
 
-    Cap_Item value;
-    Cap_Check(iterator, &value);
+    CAP_INTERNAL_TRACE(iterator, item, 0);
 
-    if(value.type != CAP_ARG) return NULL;
+    return 1;
+}
 
-    Cap_Next(iterator, NULL);
+int Cap_Peek(Cap_Iterator* iterator, int k, Cap_Item* item) {
+    if(k < 0 || k >= CAP_LOOKAHEAD_SIZE) {
+        if(item) item->type = CAP_NONE;
+        return 0;
+    }
+
+    // Peeked items are parsed once and kept in the ring until Cap_Next() takes them
+    while(iterator->lookaheadCount <= k) {
+        Cap_Item* slot = iterator->lookahead + (iterator->lookaheadStart + iterator->lookaheadCount) % CAP_LOOKAHEAD_SIZE;
+
+        if(!CapInternalRead(iterator, slot) && !CAP_INTERNAL_READ_CONFIG(iterator, slot)) {
+            if(item) item->type = CAP_NONE;
+            return 0;
+        }
+
+        iterator->lookaheadCount++;
+    }
+
+    Cap_Item* peeked = iterator->lookahead + (iterator->lookaheadStart + k) % CAP_LOOKAHEAD_SIZE;
 
-    return value.value.arg;
+    if(item) *item = *peeked;
+
+    CAP_INTERNAL_TRACE(iterator, peeked, 1);
+
+    return 1;
 }
 
-void Cap_Parse(char* arg, Cap_Item* result) {
-    CapInternalParse(arg, result, NULL);
-}
\ No newline at end of file
+int Cap_Check(Cap_Iterator* iterator, Cap_Item* item) {
+    return Cap_Peek(iterator, 0, item);
+}
+
+// Whether the rest of the arguments is exactly the argv tail
+int CapInternalAtArgv(Cap_Iterator* iterator) {
+    if(iterator->lookaheadCount > 0 || iterator->mergedFlagsCursor) return 0;
+#if defined(CAP_RESPONSE_FILES)
+    if(iterator->currentFile >= 0) return 0;
+#endif // CAP_RESPONSE_FILES
+#if defined(CAP_CONFIG_FILES)
+    if(iterator->config) return 0;
+#endif // CAP_CONFIG_FILES
+
+    return 1;
+}
+
+// Whether the item was read from the start of its argv argument, so the argument can be handed out again
+int CapInternalStartsArg(Cap_Iterator* iterator, Cap_Item* item) {
+    if(item->index < 0) return 0;
+
+    char* arg = iterator->argv[item->index];
+
+    switch(item->type) {
+        case CAP_ARG: return item->value.arg == arg;
+        case CAP_LONG_FLAG: return item->value.longFlag.str == arg + 2;
+        case CAP_FLAG: return item->offset == 1 && arg[0] == '-';
+        default: return 0;
+    }
+}
+
+int Cap_Rest(Cap_Iterator* iterator, int* argc, char*** argv) {
+    int index = iterator->index;
+
+    if(iterator->lookaheadCount > 0) {
+        // Peeked items are given back as long as the oldest one starts an argument, the later ones follow it in argv
+        Cap_Item* first = iterator->lookahead + iterator->lookaheadStart;
+        if(!CapInternalStartsArg(iterator, first)) return 0;
+
+        index = first->index;
+    } else if(!CapInternalAtArgv(iterator)) {
+        return 0;
+    }
+
+    *argc = iterator->argc - index;
+    *argv = iterator->argv + index;
+
+    iterator->index = iterator->argc;
+    iterator->mergedFlagsCursor = NULL;
+    iterator->lookaheadCount = 0;
+#if defined(CAP_RESPONSE_FILES)
+    iterator->currentFile = -1;
+    while(iterator->filesCount) CapInternalCloseResponseFile(iterator);
+#endif // CAP_RESPONSE_FILES
+
+    return 1;
+}
+
+// Most args are never asked for their length, so the parser leaves it to the first call
+int Cap_Length(Cap_Item* item) {
+    if(item->length < 0) item->length = (int)strlen(item->value.arg);
+    return item->length;
+}
+
+char* Cap_Value(Cap_Iterator* iterator, Cap_Item* item) {
+    return Cap_ValueView(iterator, item, NULL);
+}
+
+char* Cap_ValueView(Cap_Iterator* iterator, Cap_Item* item, int* length) {
+    if(item->type == CAP_ARG) return NULL;
+
+    if(item->value.attached) {
+        if(length) {
+            if(item->attachedLength < 0) item->attachedLength = (int)strlen(item->value.attached);
+            *length = item->attachedLength;
+        }
+
+        return item->value.attached;
+    }
+
+    // Items from Cap_Parse(), the environment or a config are not followed by their values in argv
+    if(item->index < 0) return NULL;
+
+    // The next item is read right in the lookahead ring, so it isn't copied or parsed twice
+    if(!Cap_Peek(iterator, 0, NULL)) return NULL;
+
+    Cap_Item* next = iterator->lookahead + iterator->lookaheadStart;
+
+    // The flag ends at "--", so the argument after it stays a general arg
+    if(next->type != CAP_ARG || next->value.arg == iterator->afterTerminator) return NULL;
+
+    char* value = next->value.arg;
+    if(length) *length = Cap_Length(next);
+
+    Cap_Next(iterator, NULL);
+
+    return value;
+}
+
+void Cap_Parse(char* arg, Cap_Item* result) {
+    CapInternalParse(arg, result, NULL, NULL);
+    result->index = -1;
+}
+
+void Cap_StreamInit(Cap_Stream* stream) {
+    stream->chunk = NULL;
+    stream->chunkLength = 0;
+    stream->mergedFlagsCursor = NULL;
+    stream->mergedFlagsBase = NULL;
+    stream->index = 0;
+    stream->length = 0;
+    stream->overflow = 0;
+}
+
+int Cap_Feed(Cap_Stream* stream, char* chunk, size_t length) {
+    // The rest of the previous chunk would be lost, and a split argument with it
+    if(stream->chunkLength || stream->mergedFlagsCursor) return 0;
+
+    stream->chunk = chunk;
+    stream->chunkLength = length;
+
+    return 1;
+}
+
+void CapInternalStreamCarry(Cap_Stream* stream, char* data, size_t length) {
+    if(stream->overflow || length > (size_t)(CAP_STREAM_BUFFER_SIZE - stream->length)) {
+        stream->overflow = 1;
+        return;
+    }
+
+    memcpy(stream->buffer + stream->length, data, length);
+    stream->length += (int)length;
+}
+
+int Cap_StreamNext(Cap_Stream* stream, Cap_Item* item) {
+    if(stream->mergedFlagsCursor) {
+        CapInternalReadMerged(&stream->mergedFlagsCursor, stream->mergedFlagsBase, item);
+        item->index = stream->index - 1;
+
+        return 1;
+    }
+
+    if(stream->chunkLength == 0) {
+        item->type = CAP_NONE;
+        return 0;
+    }
+
+    char* end = memchr(stream->chunk, '\0', stream->chunkLength);
+
+    if(!end) {
+        // The argument continues in the next chunk
+        CapInternalStreamCarry(stream, stream->chunk, stream->chunkLength);
+        stream->chunkLength = 0;
+        item->type = CAP_NONE;
+
+        return 0;
+    }
+
+    char* arg = stream->chunk;
+    size_t size = (size_t)(end - arg) + 1;
+
+    stream->chunk += size;
+    stream->chunkLength -= size;
+
+    // Only the arguments split between the chunks are copied, the rest are parsed right in the chunk
+    if(stream->length || stream->overflow) {
+        CapInternalStreamCarry(stream, arg, size);
+
+        int overflow = stream->overflow;
+
+        arg = stream->buffer;
+        stream->length = 0;
+        stream->overflow = 0;
+
+        if(overflow) {
+            stream->index++;
+            item->type = CAP_NONE;
+            return -1;
+        }
+    }
+
+    CapInternalParse(arg, item, &stream->mergedFlagsCursor, NULL);
+    item->index = stream->index++;
+    stream->mergedFlagsBase = arg;
+
+    return 1;
+}
+
+#if defined(CAP_ARENA)
+
+void Cap_ArenaInit(Cap_Arena* arena, void* buffer, size_t size) {
+    arena->buffer = buffer;
+    arena->capacity = buffer ? size : 0;
+    arena->used = 0;
+    arena->initial = arena->buffer;
+    arena->initialCapacity = arena->capacity;
+    arena->chunks = NULL;
+}
+
+// Chunks are mapped right from the system, so the arena never calls malloc()
+char* CapInternalArenaMap(Cap_Arena* arena, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if(size > (size_t)-1 - page) return NULL;
+
+    size_t mappedSize = (size + page - 1) / page * page;
+
+    void* data = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED) return NULL;
+
+    Cap_ArenaChunk* chunk = data;
+    chunk->previous = arena->chunks;
+    chunk->size = mappedSize;
+    arena->chunks = chunk;
+
+    return data;
+}
+
+void* Cap_ArenaAlloc(Cap_Arena* arena, size_t size) {
+    if(size == 0) size = 1;
+
+    size_t left = arena->capacity - arena->used;
+    size_t padding = (size_t)(0 - ((uintptr_t)arena->buffer + arena->used)) & (CAP_ARENA_ALIGN - 1);
+
+    if(size <= left && padding <= left - size) {
+        char* result = arena->buffer + arena->used + padding;
+        arena->used += padding + size;
+
+        return result;
+    }
+
+    size_t header = (sizeof(Cap_ArenaChunk) + CAP_ARENA_ALIGN - 1) / CAP_ARENA_ALIGN * CAP_ARENA_ALIGN;
+    if(size > (size_t)-1 - header) return NULL;
+
+    // Big allocations get a chunk of their own, so the rest of the current block still serves the small ones
+    if(size > CAP_ARENA_CHUNK_SIZE / 4) {
+        char* chunk = CapInternalArenaMap(arena, header + size);
+
+        return chunk ? chunk + header : NULL;
+    }
+
+    char* chunk = CapInternalArenaMap(arena, CAP_ARENA_CHUNK_SIZE);
+    if(!chunk) return NULL;
+
+    arena->buffer = chunk + header;
+    arena->capacity = arena->chunks->size - header;
+    arena->used = size;
+
+    return arena->buffer;
+}
+
+char* Cap_ArenaString(Cap_Arena* arena, const char* str, int length) {
+    if(length < 0) length = (int)strlen(str);
+
+    char* copy = Cap_ArenaAlloc(arena, (size_t)length + 1);
+    if(!copy) return NULL;
+
+    memcpy(copy, str, (size_t)length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+char** Cap_ArenaSplit(Cap_Arena* arena, const char* line, int* argc) {
+    char* cursor = Cap_ArenaString(arena, line, -1);
+    if(!cursor) return NULL;
+
+    // argv grows twice at a time, the old copies stay in the arena until it is released
+    int capacity = 16;
+    int count = 0;
+
+    char** argv = CAP_ARENA_ARRAY(arena, char*, capacity + 1);
+    if(!argv) return NULL;
+
+    for(char* arg; (arg = CapInternalSplit(&cursor));) {
+        if(count == capacity) {
+            char** grown = CAP_ARENA_ARRAY(arena, char*, capacity * 2 + 1);
+            if(!grown) return NULL;
+
+            memcpy(grown, argv, sizeof(char*) * (size_t)count);
+            argv = grown;
+            capacity *= 2;
+        }
+
+        argv[count++] = arg;
+    }
+
+    argv[count] = NULL;
+
+    if(argc) *argc = count;
+
+    return argv;
+}
+
+void Cap_ArenaRelease(Cap_Arena* arena) {
+    while(arena->chunks) {
+        Cap_ArenaChunk* chunk = arena->chunks;
+        arena->chunks = chunk->previous;
+
+        munmap(chunk, chunk->size);
+    }
+
+    arena->buffer = arena->initial;
+    arena->capacity = arena->initialCapacity;
+    arena->used = 0;
+}
+
+#endif // CAP_ARENA
+
+#if defined(CAP_PROC_SCANNER)
+
+int CapInternalReadCmdline(int procFd, char* pid, char* buffer, size_t bufferSize) {
+    char path[64];
+    size_t pidLength = strlen(pid);
+
+    if(pidLength + sizeof("/cmdline") > sizeof(path)) return -1;
+
+    memcpy(path, pid, pidLength);
+    memcpy(path + pidLength, "/cmdline", sizeof("/cmdline"));
+
+    int fd = openat(procFd, path, O_RDONLY);
+    if(fd < 0) return -1;
+
+    // The last byte is reserved for the terminator of a truncated cmdline
+    size_t length = 0;
+    while(length < bufferSize - 1) {
+        ssize_t count = pread(fd, buffer + length, bufferSize - 1 - length, (off_t)length);
+        if(count <= 0) break;
+
+        length += (size_t)count;
+    }
+
+    close(fd);
+
+    buffer[length] = '\0';
+
+    return (int)length;
+}
+
+int Cap_ScanProcesses(Cap_ProcessScanner* scanner, Cap_ProcessCallback* callback, void* context) {
+    // At least one char and the terminator, the reads below rely on it
+    if(scanner->bufferSize < 2) return -1;
+
+    DIR* proc = opendir("/proc");
+    if(!proc) return -1;
+
+    int procFd = dirfd(proc);
+    int scanned = 0;
+
+    for(struct dirent* entry; (entry = readdir(proc));) {
+        char* name = entry->d_name;
+
+        int pid = 0;
+        char* cursor = name;
+        for(; *cursor >= '0' && *cursor <= '9'; cursor++) pid = pid * 10 + (*cursor - '0');
+        if(cursor == name || *cursor) continue;
+
+        int length = CapInternalReadCmdline(procFd, name, scanner->buffer, scanner->bufferSize);
+
+        // Kernel threads have an empty cmdline
+        if(length <= 0) continue;
+
+        int argc = 0;
+        for(char* arg = scanner->buffer; arg < scanner->buffer + length && argc < scanner->argvCapacity; arg += strlen(arg) + 1) {
+            scanner->argv[argc++] = arg;
+        }
+
+        if(scanner->tokens.types) {
+            Cap_Tokenize(argc - 1, scanner->argv + 1, &scanner->tokens);
+        }
+
+        scanned++;
+
+        if(callback(pid, argc, scanner->argv, &scanner->tokens, context)) break;
+    }
+
+    closedir(proc);
+
+    return scanned;
+}
+
+#endif // CAP_PROC_SCANNER
+
+// Reads decimal digits into *result, returns the end of the digits or NULL on overflow
+char* CapInternalReadDigits(char* str, unsigned long long* result) {
+    unsigned long long value = 0;
+
+    for(; *str >= '0' && *str <= '9'; str++) {
+        unsigned digit = (unsigned)(*str - '0');
+
+        if(value > (~0ULL - digit) / 10) return NULL;
+
+        value = value * 10 + digit;
+    }
+
+    *result = value;
+
+    return str;
+}
+
+int Cap_ToU64(char* str, unsigned long long* result) {
+    if(!str) return CAP_VALUE_MISSING;
+
+    if(*str == '+') str++;
+    if(*str < '0' || *str > '9') return CAP_VALUE_INVALID;
+
+    unsigned long long value;
+    char* end = CapInternalReadDigits(str, &value);
+
+    if(!end) {
+        while(*str >= '0' && *str <= '9') str++;
+        return *str ? CAP_VALUE_INVALID : CAP_VALUE_RANGE;
+    }
+    if(*end) return CAP_VALUE_INVALID;
+
+    *result = value;
+
+    return CAP_VALUE_OK;
+}
+
+int Cap_ToInt(char* str, long long* result) {
+    if(!str) return CAP_VALUE_MISSING;
+
+    int negative = *str == '-';
+    if(*str == '-' || *str == '+') str++;
+
+    if(*str == '-' || *str == '+') return CAP_VALUE_INVALID;
+
+    unsigned long long value;
+    int status = Cap_ToU64(str, &value);
+
+    if(status != CAP_VALUE_OK) return status;
+
+    unsigned long long limit = negative ? (unsigned long long)LLONG_MAX + 1 : (unsigned long long)LLONG_MAX;
+    if(value > limit) return CAP_VALUE_RANGE;
+
+    *result = negative ? (long long)(0 - value) : (long long)value;
+
+    return CAP_VALUE_OK;
+}
+
+// The decimal point is the only part of a number strtod() reads by the locale, so the checked string is
+// passed as digits and an exponent without it. 768 significant digits decide the rounding of any double,
+// the ones after them are kept as a single sticky digit, so the copy is bounded and the result is the same.
+double CapInternalStrtod(const char* str) {
+    char buffer[800];
+    int length = 0;
+    int significant = 0;
+    int fraction = 0;
+    int sticky = 0;
+    long exponent = 0;
+
+    if(*str == '-' || *str == '+') buffer[length++] = *str++;
+
+    for(; (*str >= '0' && *str <= '9') || *str == '.'; str++) {
+        if(*str == '.') {
+            fraction = 1;
+        } else if(significant == 0 && *str == '0') {
+            exponent -= fraction;
+        } else if(significant < 768) {
+            buffer[length++] = *str;
+            significant++;
+            exponent -= fraction;
+        } else {
+            exponent += !fraction;
+            sticky |= *str != '0';
+        }
+    }
+
+    if(significant == 0) buffer[length++] = '0';
+
+    if(sticky) {
+        buffer[length++] = '1';
+        exponent--;
+    }
+
+    if(*str == 'e' || *str == 'E') {
+        str++;
+
+        int negative = *str == '-';
+        if(*str == '-' || *str == '+') str++;
+
+        long value = 0;
+        for(; *str >= '0' && *str <= '9'; str++) {
+            if(value < 100000) value = value * 10 + (*str - '0');
+        }
+
+        exponent += negative ? -value : value;
+    }
+
+    buffer[length++] = 'e';
+
+    if(exponent < 0) {
+        buffer[length++] = '-';
+        exponent = -exponent;
+    }
+
+    char digits[24];
+    int count = 0;
+
+    do {
+        digits[count++] = (char)('0' + exponent % 10);
+        exponent /= 10;
+    } while(exponent);
+
+    while(count) buffer[length++] = digits[--count];
+    buffer[length] = '\0';
+
+    return strtod(buffer, NULL);
+}
+
+int Cap_ToDouble(char* str, double* result) {
+    // Exactly representable powers of ten
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    if(!str) return CAP_VALUE_MISSING;
+
+    char* cursor = str;
+    int negative = *cursor == '-';
+    if(*cursor == '-' || *cursor == '+') cursor++;
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int hasDigits = 0;
+
+    for(; *cursor >= '0' && *cursor <= '9'; cursor++, hasDigits = 1) {
+        if(mantissa == 0 && *cursor == '0') continue;
+
+        if(digits < 19) mantissa = mantissa * 10 + (unsigned)(*cursor - '0');
+        else exponent++;
+
+        digits++;
+    }
+
+    if(*cursor == '.') {
+        for(cursor++; *cursor >= '0' && *cursor <= '9'; cursor++, hasDigits = 1) {
+            if(mantissa == 0 && *cursor == '0') {
+                exponent--;
+                continue;
+            }
+
+            if(digits < 19) {
+                mantissa = mantissa * 10 + (unsigned)(*cursor - '0');
+                exponent--;
+            }
+
+            digits++;
+        }
+    }
+
+    if(!hasDigits) return CAP_VALUE_INVALID;
+
+    if(*cursor == 'e' || *cursor == 'E') {
+        cursor++;
+
+        int exponentNegative = *cursor == '-';
+        if(*cursor == '-' || *cursor == '+') cursor++;
+
+        if(*cursor < '0' || *cursor > '9') return CAP_VALUE_INVALID;
+
+        int value = 0;
+        for(; *cursor >= '0' && *cursor <= '9'; cursor++) {
+            if(value < 100000) value = value * 10 + (*cursor - '0');
+        }
+
+        exponent += exponentNegative ? -value : value;
+    }
+
+    if(*cursor) return CAP_VALUE_INVALID;
+
+    double value;
+
+    // Clinger's fast path: both the mantissa and the power of ten are exact, so a single
+    // operation gives the correctly rounded result. The rest goes to strtod().
+    if(digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        value = (double)mantissa;
+        value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+        if(negative) value = -value;
+    } else if(mantissa == 0) {
+        value = negative ? -0.0 : 0.0;
+    } else {
+        value = CapInternalStrtod(str);
+    }
+
+    if(value > DBL_MAX || value < -DBL_MAX) return CAP_VALUE_RANGE;
+
+    *result = value;
+
+    return CAP_VALUE_OK;
+}
+
+int Cap_ToSize(char* str, unsigned long long* result) {
+    if(!str) return CAP_VALUE_MISSING;
+
+    if(*str < '0' || *str > '9') return CAP_VALUE_INVALID;
+
+    unsigned long long value;
+    char* cursor = CapInternalReadDigits(str, &value);
+
+    if(!cursor) return CAP_VALUE_RANGE;
+
+    int shift = 0;
+    switch(*cursor) {
+        case 'k': case 'K': shift = 10; break;
+        case 'm': case 'M': shift = 20; break;
+        case 'g': case 'G': shift = 30; break;
+        case 't': case 'T': shift = 40; break;
+        case 'p': case 'P': shift = 50; break;
+    }
+
+    if(shift) {
+        cursor++;
+        if(*cursor == 'i' && cursor[1] == 'B') cursor++;
+    }
+    if(*cursor == 'B') cursor++;
+
+    if(*cursor) return CAP_VALUE_INVALID;
+
+    if(shift && value > (~0ULL >> shift)) return CAP_VALUE_RANGE;
+
+    *result = value << shift;
+
+    return CAP_VALUE_OK;
+}
+
+int Cap_ToDuration(char* str, unsigned long long* result) {
+    if(!str) return CAP_VALUE_MISSING;
+
+    if(*str < '0' || *str > '9') return CAP_VALUE_INVALID;
+
+    unsigned long long total = 0;
+    char* cursor = str;
+
+    // Sequence of <number><unit> pairs(1h30m), a single number without a unit is seconds
+    while(*cursor) {
+        if(*cursor < '0' || *cursor > '9') return CAP_VALUE_INVALID;
+
+        char* number = cursor;
+        unsigned long long value;
+        cursor = CapInternalReadDigits(cursor, &value);
+
+        if(!cursor) return CAP_VALUE_RANGE;
+
+        unsigned long long unit;
+        switch(*cursor) {
+            case 'n': unit = 1ULL; cursor++; break;
+            case 'u': unit = 1000ULL; cursor++; break;
+            case 'm':
+                if(cursor[1] == 's') {
+                    unit = 1000000ULL;
+                    cursor++;
+                } else {
+                    unit = 60000000000ULL;
+                }
+                cursor++;
+                break;
+            case 's': unit = 1000000000ULL; cursor++; break;
+            case 'h': unit = 3600000000000ULL; cursor++; break;
+            case 'd': unit = 86400000000000ULL; cursor++; break;
+            case '\0':
+                if(number != str) return CAP_VALUE_INVALID;
+                unit = 1000000000ULL;
+                break;
+            default:
+                return CAP_VALUE_INVALID;
+        }
+
+        // "ns" and "us" units have 's' after the prefix
+        if(unit <= 1000ULL) {
+            if(*cursor != 's') return CAP_VALUE_INVALID;
+            cursor++;
+        }
+
+        if(value > (~0ULL - total) / unit) return CAP_VALUE_RANGE;
+
+        total += value * unit;
+    }
+
+    *result = total;
+
+    return CAP_VALUE_OK;
+}
+
+int Cap_ValueInt(Cap_Iterator* iterator, Cap_Item* item, long long* result) {
+    return Cap_ToInt(Cap_Value(iterator, item), result);
+}
+
+int Cap_ValueU64(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result) {
+    return Cap_ToU64(Cap_Value(iterator, item), result);
+}
+
+int Cap_ValueDouble(Cap_Iterator* iterator, Cap_Item* item, double* result) {
+    return Cap_ToDouble(Cap_Value(iterator, item), result);
+}
+
+int Cap_ValueSize(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result) {
+    return Cap_ToSize(Cap_Value(iterator, item), result);
+}
+
+int Cap_ValueDuration(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result) {
+    return Cap_ToDuration(Cap_Value(iterator, item), result);
+}
+
+// Length of the UTF-8 sequence at str or 0 if it is invalid: overlong forms, surrogates and code points above U+10FFFF are rejected
+int CapInternalUtf8Sequence(const unsigned char* str, int left) {
+    unsigned char ch = str[0];
+
+    if(ch < 0x80) return 1;
+    if(ch < 0xC2) return 0;
+
+    if(ch < 0xE0) return left >= 2 && (str[1] & 0xC0) == 0x80 ? 2 : 0;
+
+    if(ch < 0xF0) {
+        if(left < 3 || (str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80) return 0;
+        if(ch == 0xE0 && str[1] < 0xA0) return 0;
+        if(ch == 0xED && str[1] > 0x9F) return 0;
+
+        return 3;
+    }
+
+    if(ch < 0xF5) {
+        if(left < 4 || (str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80 || (str[3] & 0xC0) != 0x80) return 0;
+        if(ch == 0xF0 && str[1] < 0x90) return 0;
+        if(ch == 0xF4 && str[1] > 0x8F) return 0;
+
+        return 4;
+    }
+
+    return 0;
+}
+
+int CapInternalUtf8Scalar(const unsigned char* str, int from, int length) {
+    int i = from;
+
+    while(i < length) {
+#if defined(__SSE2__)
+        // ASCII runs are skipped 16 bytes at a time
+        while(i + 16 <= length && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(str + i)))) i += 16;
+
+        if(i >= length) break;
+#endif // __SSE2__
+        int sequence = CapInternalUtf8Sequence(str + i, length - i);
+        if(!sequence) return i;
+
+        i += sequence;
+    }
+
+    return -1;
+}
+
+#if defined(CAP_INTERNAL_UTF8_AVX2)
+
+// The lookup algorithm of simdjson(Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"):
+// every byte is classified by the high and low nibbles of the previous byte and the high nibble of itself,
+// the three lookups are ANDed and any bit left is an error
+#define CAP_INTERNAL_UTF8_TOO_SHORT (1 << 0)
+#define CAP_INTERNAL_UTF8_TOO_LONG (1 << 1)
+#define CAP_INTERNAL_UTF8_OVERLONG_3 (1 << 2)
+#define CAP_INTERNAL_UTF8_TOO_LARGE (1 << 3)
+#define CAP_INTERNAL_UTF8_SURROGATE (1 << 4)
+#define CAP_INTERNAL_UTF8_OVERLONG_2 (1 << 5)
+#define CAP_INTERNAL_UTF8_TOO_LARGE_1000 (1 << 6)
+#define CAP_INTERNAL_UTF8_OVERLONG_4 (1 << 6)
+#define CAP_INTERNAL_UTF8_TWO_CONTS (1 << 7)
+#define CAP_INTERNAL_UTF8_CARRY (CAP_INTERNAL_UTF8_TOO_SHORT | CAP_INTERNAL_UTF8_TOO_LONG | CAP_INTERNAL_UTF8_TWO_CONTS)
+
+#define CAP_INTERNAL_UTF8_TABLE(A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P)\
+    _mm256_setr_epi8(\
+        (char)(A), (char)(B), (char)(C), (char)(D), (char)(E), (char)(F), (char)(G), (char)(H),\
+        (char)(I), (char)(J), (char)(K), (char)(L), (char)(M), (char)(N), (char)(O), (char)(P),\
+        (char)(A), (char)(B), (char)(C), (char)(D), (char)(E), (char)(F), (char)(G), (char)(H),\
+        (char)(I), (char)(J), (char)(K), (char)(L), (char)(M), (char)(N), (char)(O), (char)(P)\
+    )
+
+// Bytes of the previous block shifted in front of the current one
+#define CAP_INTERNAL_UTF8_PREV(INPUT, PREVIOUS, N)\
+    _mm256_alignr_epi8(INPUT, _mm256_permute2x128_si256(PREVIOUS, INPUT, 0x21), 16 - (N))
+
+CAP_INTERNAL_TARGET_AVX2 __m256i CapInternalUtf8Errors(__m256i input, __m256i previous) {
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+
+    __m256i prev1 = CAP_INTERNAL_UTF8_PREV(input, previous, 1);
+
+    __m256i byte1High = _mm256_shuffle_epi8(CAP_INTERNAL_UTF8_TABLE(
+        CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG,
+        CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG, CAP_INTERNAL_UTF8_TOO_LONG,
+        CAP_INTERNAL_UTF8_TWO_CONTS, CAP_INTERNAL_UTF8_TWO_CONTS, CAP_INTERNAL_UTF8_TWO_CONTS, CAP_INTERNAL_UTF8_TWO_CONTS,
+        CAP_INTERNAL_UTF8_TOO_SHORT | CAP_INTERNAL_UTF8_OVERLONG_2,
+        CAP_INTERNAL_UTF8_TOO_SHORT,
+        CAP_INTERNAL_UTF8_TOO_SHORT | CAP_INTERNAL_UTF8_OVERLONG_3 | CAP_INTERNAL_UTF8_SURROGATE,
+        CAP_INTERNAL_UTF8_TOO_SHORT | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000 | CAP_INTERNAL_UTF8_OVERLONG_4
+    ), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+
+    __m256i byte1Low = _mm256_shuffle_epi8(CAP_INTERNAL_UTF8_TABLE(
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_OVERLONG_3 | CAP_INTERNAL_UTF8_OVERLONG_2 | CAP_INTERNAL_UTF8_OVERLONG_4,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_OVERLONG_2,
+        CAP_INTERNAL_UTF8_CARRY,
+        CAP_INTERNAL_UTF8_CARRY,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000 | CAP_INTERNAL_UTF8_SURROGATE,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000,
+        CAP_INTERNAL_UTF8_CARRY | CAP_INTERNAL_UTF8_TOO_LARGE | CAP_INTERNAL_UTF8_TOO_LARGE_1000
+    ), _mm256_and_si256(prev1, lowNibble));
+
+    __m256i byte2High = _mm256_shuffle_epi8(CAP_INTERNAL_UTF8_TABLE(
+        CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT,
+        CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT,
+        CAP_INTERNAL_UTF8_TOO_LONG | CAP_INTERNAL_UTF8_OVERLONG_2 | CAP_INTERNAL_UTF8_TWO_CONTS | CAP_INTERNAL_UTF8_OVERLONG_3 | CAP_INTERNAL_UTF8_TOO_LARGE_1000 | CAP_INTERNAL_UTF8_OVERLONG_4,
+        CAP_INTERNAL_UTF8_TOO_LONG | CAP_INTERNAL_UTF8_OVERLONG_2 | CAP_INTERNAL_UTF8_TWO_CONTS | CAP_INTERNAL_UTF8_OVERLONG_3 | CAP_INTERNAL_UTF8_TOO_LARGE,
+        CAP_INTERNAL_UTF8_TOO_LONG | CAP_INTERNAL_UTF8_OVERLONG_2 | CAP_INTERNAL_UTF8_TWO_CONTS | CAP_INTERNAL_UTF8_SURROGATE | CAP_INTERNAL_UTF8_TOO_LARGE,
+        CAP_INTERNAL_UTF8_TOO_LONG | CAP_INTERNAL_UTF8_OVERLONG_2 | CAP_INTERNAL_UTF8_TWO_CONTS | CAP_INTERNAL_UTF8_SURROGATE | CAP_INTERNAL_UTF8_TOO_LARGE,
+        CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT, CAP_INTERNAL_UTF8_TOO_SHORT
+    ), _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+    // The third and the fourth bytes of a sequence have to be continuations, but only the 2-byte lookups see it
+    __m256i third = _mm256_subs_epu8(CAP_INTERNAL_UTF8_PREV(input, previous, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(CAP_INTERNAL_UTF8_PREV(input, previous, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must23, special);
+}
+
+CAP_INTERNAL_TARGET_AVX2 int CapInternalUtf8Avx2(const char* str, int length) {
+    const unsigned char* bytes = (const unsigned char*)str;
+
+    // Lead bytes in the last 3 positions that still wait for continuations
+    const __m256i incompleteMax = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+    );
+
+    __m256i previous = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    __m256i errors = _mm256_setzero_si256();
+
+    int i = 0;
+
+    for(; i < length; i += 32) {
+        __m256i input;
+
+        if(i + 32 <= length) {
+            input = _mm256_loadu_si256((const __m256i*)(bytes + i));
+        } else {
+            // The tail is padded with zeros, so a sequence cut by the end is caught as too short
+            unsigned char tail[32] = { 0 };
+            memcpy(tail, bytes + i, (size_t)(length - i));
+            input = _mm256_loadu_si256((const __m256i*)tail);
+        }
+
+        if(_mm256_movemask_epi8(input)) {
+            errors = _mm256_or_si256(errors, CapInternalUtf8Errors(input, previous));
+            incomplete = _mm256_subs_epu8(input, incompleteMax);
+        } else {
+            errors = _mm256_or_si256(errors, incomplete);
+            incomplete = _mm256_setzero_si256();
+        }
+
+        previous = input;
+
+        if(!_mm256_testz_si256(errors, errors)) break;
+    }
+
+    if(i >= length && _mm256_testz_si256(incomplete, incomplete) && _mm256_testz_si256(errors, errors)) return -1;
+
+    // The error is in this block or in a sequence started right before it,
+    // the exact offset is found by the scalar check from the last lead byte before the block
+    int from = i > 3 ? i - 3 : 0;
+    while(from > 0 && (bytes[from] & 0xC0) == 0x80) from--;
+
+    return CapInternalUtf8Scalar(bytes, from, length);
+}
+
+int Cap_Utf8Check(const char* str, int length) {
+#if defined(CAP_INTERNAL_UTF8_DISPATCH)
+    if(!__builtin_cpu_supports("avx2")) return CapInternalUtf8Scalar((const unsigned char*)str, 0, length);
+#endif // CAP_INTERNAL_UTF8_DISPATCH
+
+    return CapInternalUtf8Avx2(str, length);
+}
+
+#else
+
+int Cap_Utf8Check(const char* str, int length) {
+    return CapInternalUtf8Scalar((const unsigned char*)str, 0, length);
+}
+
+#endif // CAP_INTERNAL_UTF8_AVX2
+
+// Locals are used instead of the Cap_Tokens fields, otherwise every "types" store
+// (signed char can alias anything) forces the compiler to reload them
+#define CAP_INTERNAL_PUSH_TOKEN(TYPE, OFFSET, LENGTH, ATTACHED)\
+    if(count >= capacity) {\
+        tokens->length = count;\
+        return 0;\
+    }\
+    types[count] = TYPE;\
+    if(indexes) indexes[count] = i;\
+    if(offsets) offsets[count] = OFFSET;\
+    if(lengths) lengths[count] = LENGTH;\
+    if(attached) attached[count] = ATTACHED;\
+    count++;
+
+// Tokenizes argv[from..to), the indexes are relative to argv. optionsEnded is set if a "--" comes before from
+int CapInternalTokenize(char** argv, int from, int to, Cap_Tokens* tokens, int optionsEnded) {
+    int count = 0;
+    int capacity = tokens->capacity;
+    signed char* types = tokens->types;
+    int* indexes = tokens->indexes;
+    int* offsets = tokens->offsets;
+    int* lengths = tokens->lengths;
+    int* attached = tokens->attached;
+    Cap_Utf8Error* utf8 = tokens->utf8;
+
+    if(utf8) utf8->index = -1;
+
+    for(int i = from; i < to; i++) {
+        char* arg = argv[i];
+        char* end; // where the tokenizer stopped reading the argument
+
+        if(arg[0] != '-' || optionsEnded) {
+            int length = lengths || utf8 ? (int)strlen(arg) : 0;
+
+            CAP_INTERNAL_PUSH_TOKEN(CAP_ARG, 0, length, 0);
+            end = arg + length;
+        } else if(arg[1] == '-') {
+            // The terminator is not a token, just like for Cap_Next()
+            if(!arg[2]) {
+                optionsEnded = 1;
+                continue;
+            }
+
+            int length = (int)CAP_STR_CSPN(arg + 2, "=");
+
+            CAP_INTERNAL_PUSH_TOKEN(CAP_LONG_FLAG, 2, length, arg[length + 2] && arg[length + 3] ? length + 3 : 0);
+            end = arg + length + 2;
+        } else {
+            // Every char of the merged flags(-abc=value) is a separate token, the last one gets the value
+            char* cursor = arg + 1;
+
+            for(;; cursor++) {
+                char next = cursor[0] ? cursor[1] : '\0';
+
+                CAP_INTERNAL_PUSH_TOKEN(CAP_FLAG, (int)(cursor - arg), 1, next == '=' && cursor[2] ? (int)(cursor - arg) + 2 : 0);
+
+                if(next == '\0' || next == '=') break;
+            }
+
+            end = cursor;
+        }
+
+        // The argument was just read by the tokenizer, so it is validated while it is still in the cache
+        // and only the part the tokenizer skipped(the value after '=') is measured
+        if(utf8 && utf8->index < 0) {
+            int offset = Cap_Utf8Check(arg, (int)(end - arg) + (int)strlen(end));
+
+            if(offset >= 0) {
+                utf8->index = i;
+                utf8->offset = offset;
+            }
+        }
+    }
+
+    tokens->length = count;
+
+    return 1;
+}
+
+#undef CAP_INTERNAL_PUSH_TOKEN
+
+int Cap_Tokenize(int argc, char** argv, Cap_Tokens* tokens) {
+    return CapInternalTokenize(argv, 0, argc, tokens, 0);
+}
+
+#if defined(CAP_PARALLEL_TOKENIZE)
+
+typedef struct CapInternalTokenizeRange {
+    char** argv;
+    int from;
+    int to;
+    int count;
+    int terminated; // the range has a "--"
+    int optionsEnded; // an earlier range has a "--"
+    Cap_Tokens tokens;
+    Cap_Utf8Error utf8;
+} CapInternalTokenizeRange;
+
+// Number of tokens Cap_Tokenize() produces for argv[from..to) if the options didn't end before it
+void* CapInternalCountTokens(void* context) {
+    CapInternalTokenizeRange* range = context;
+    int count = 0;
+
+    range->terminated = 0;
+
+    for(int i = range->from; i < range->to; i++) {
+        char* arg = range->argv[i];
+
+        if(arg[0] != '-' || range->terminated) {
+            count++;
+            continue;
+        }
+
+        if(arg[1] == '-') {
+            if(arg[2]) count++;
+            else range->terminated = 1;
+
+            continue;
+        }
+
+        for(char* cursor = arg + 1;; cursor++) {
+            char next = cursor[0] ? cursor[1] : '\0';
+
+            count++;
+
+            if(next == '\0' || next == '=') break;
+        }
+    }
+
+    range->count = count;
+
+    return NULL;
+}
+
+void* CapInternalTokenizeWorker(void* context) {
+    CapInternalTokenizeRange* range = context;
+
+    CapInternalTokenize(range->argv, range->from, range->to, &range->tokens, range->optionsEnded);
+
+    return NULL;
+}
+
+// Runs the worker for every range, the first range is handled by the calling thread
+void CapInternalRunRanges(CapInternalTokenizeRange* ranges, int count, void* worker(void*)) {
+    pthread_t threads[CAP_PARALLEL_TOKENIZE_MAX];
+    int started = 1;
+
+    for(; started < count; started++) {
+        if(pthread_create(threads + started, NULL, worker, ranges + started) != 0) break;
+    }
+
+    worker(ranges);
+
+    // Ranges without a thread are handled here
+    for(int i = started; i < count; i++) worker(ranges + i);
+    for(int i = 1; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+int Cap_TokenizeParallel(int argc, char** argv, Cap_Tokens* tokens, int threads) {
+    if(threads > CAP_PARALLEL_TOKENIZE_MAX) threads = CAP_PARALLEL_TOKENIZE_MAX;
+    if(threads > argc / CAP_PARALLEL_TOKENIZE_MIN) threads = argc / CAP_PARALLEL_TOKENIZE_MIN;
+
+    if(threads <= 1) return Cap_Tokenize(argc, argv, tokens);
+
+    CapInternalTokenizeRange ranges[CAP_PARALLEL_TOKENIZE_MAX];
+
+    for(int i = 0; i < threads; i++) {
+        ranges[i].argv = argv;
+        ranges[i].from = (int)((long long)argc * i / threads);
+        ranges[i].to = (int)((long long)argc * (i + 1) / threads);
+    }
+
+    CapInternalRunRanges(ranges, threads, CapInternalCountTokens);
+
+    // After the first "--" every argument of the later ranges is a single general arg
+    int optionsEnded = 0;
+    for(int i = 0; i < threads; i++) {
+        ranges[i].optionsEnded = optionsEnded;
+
+        if(optionsEnded) ranges[i].count = ranges[i].to - ranges[i].from;
+        else optionsEnded = ranges[i].terminated;
+    }
+
+    // Every range gets its own slice of the table, so the ranges are written in place without merging
+    int offset = 0;
+    for(int i = 0; i < threads; i++) {
+        Cap_Tokens* slice = &ranges[i].tokens;
+
+        slice->capacity = ranges[i].count;
+        slice->length = 0;
+        slice->types = tokens->types + offset;
+        slice->indexes = tokens->indexes ? tokens->indexes + offset : NULL;
+        slice->offsets = tokens->offsets ? tokens->offsets + offset : NULL;
+        slice->lengths = tokens->lengths ? tokens->lengths + offset : NULL;
+        slice->attached = tokens->attached ? tokens->attached + offset : NULL;
+        slice->utf8 = tokens->utf8 ? &ranges[i].utf8 : NULL;
+
+        offset += ranges[i].count;
+    }
+
+    // The sequential version fills the table as much as it can, so the overflow is left to it
+    if(offset > tokens->capacity) return Cap_Tokenize(argc, argv, tokens);
+
+    CapInternalRunRanges(ranges, threads, CapInternalTokenizeWorker);
+
+    tokens->length = offset;
+
+    // The first range with an invalid argument has the first one overall
+    if(tokens->utf8) {
+        tokens->utf8->index = -1;
+
+        for(int i = 0; i < threads && tokens->utf8->index < 0; i++) *tokens->utf8 = ranges[i].utf8;
+    }
+
+    return 1;
+}
+
+#endif // CAP_PARALLEL_TOKENIZE
+
+int Cap_ScanFlags(int argc, char** argv, Cap_FlagSet* set) {
+    unsigned long long* seen = set->seen;
+    int* counts = set->counts;
+    int total = 0;
+
+    // Only the bits are cleared, a count is reset when its char is seen for the first time
+    seen[0] = seen[1] = seen[2] = seen[3] = 0;
+
+    for(int i = 0; i < argc; i++) {
+        char* arg = argv[i];
+
+        if(arg[0] != '-' || arg[1] == '\0') continue;
+
+        // Nothing after "--" is a flag
+        if(arg[1] == '-') {
+            if(!arg[2]) break;
+            continue;
+        }
+
+        // Every char of the bundle(-xvzf=value) up to '=' is counted without the item dispatch
+        unsigned char* cursor = (unsigned char*)arg + 1;
+
+        do {
+            unsigned char ch = *cursor++;
+            unsigned long long bit = 1ULL << (ch & 63);
+            int wasSeen = (seen[ch >> 6] & bit) != 0;
+
+            counts[ch] = (counts[ch] & -wasSeen) + 1;
+            seen[ch >> 6] |= bit;
+        } while(*cursor && *cursor != '=');
+
+        total += (int)(cursor - (unsigned char*)arg) - 1;
+    }
+
+    return total;
+}
+
+#define CAP_INTERNAL_HASH_STEP(HASH, CH) (((HASH) ^ (unsigned char)(CH)) * 16777619u)
+
+// The tables are probed linearly, so they are kept at most 3/4 full to keep the probe chains short
+int CapInternalTableFull(int count, int capacity) {
+    return (count + 1) * 4 > capacity * 3;
+}
+
+unsigned int CapInternalHash(const char* str, int length) {
+    unsigned int hash = 2166136261u;
+
+    for(int i = 0; i < length; i++) {
+        hash = CAP_INTERNAL_HASH_STEP(hash, str[i]);
+    }
+
+    return hash;
+}
+
+void Cap_SpecInit(Cap_Spec* spec, Cap_Option** slots, int capacity) {
+    for(int i = 0; i < 256; i++) spec->flags[i] = NULL;
+    for(int i = 0; i < capacity; i++) slots[i] = NULL;
+
+    spec->longFlags = slots;
+    spec->capacity = capacity;
+    spec->count = 0;
+    spec->ids = 0;
+}
+
+Cap_Option** CapInternalSpecSlot(Cap_Spec* spec, const char* name, int length, unsigned int hash) {
+    unsigned int mask = (unsigned int)spec->capacity - 1;
+    unsigned int index = hash & mask;
+
+    Cap_Option** slot;
+    while(*(slot = spec->longFlags + index)) {
+        Cap_Option* option = *slot;
+
+        if(option->hash == hash && option->nameLength == length && strncmp(option->name, name, (size_t)length) == 0) break;
+
+        index = (index + 1) & mask;
+    }
+
+    return slot;
+}
+
+int Cap_SpecAdd(Cap_Spec* spec, Cap_Option* option) {
+    unsigned char ch = (unsigned char)option->ch;
+
+    if(ch && spec->flags[ch]) return 0;
+
+    Cap_Option** slot = NULL;
+
+    if(option->name) {
+        if(CapInternalTableFull(spec->count, spec->capacity)) return 0;
+
+        option->nameLength = (int)strlen(option->name);
+        option->hash = CapInternalHash(option->name, option->nameLength);
+
+        slot = CapInternalSpecSlot(spec, option->name, option->nameLength, option->hash);
+        if(*slot) return 0;
+    }
+
+    if(ch) spec->flags[ch] = option;
+
+    if(slot) {
+        *slot = option;
+        spec->count++;
+    }
+
+    option->id = spec->ids++;
+
+    return 1;
+}
+
+Cap_Option* Cap_SpecFind(Cap_Spec* spec, Cap_Item* item) {
+    switch(item->type) {
+        case CAP_FLAG:
+            return spec->flags[(unsigned char)item->value.flag.ch];
+
+        case CAP_LONG_FLAG: {
+            Cap_LongFlag* flag = &item->value.longFlag;
+
+            if(spec->count == 0) return NULL;
+
+            return *CapInternalSpecSlot(spec, flag->str, flag->length, CapInternalHash(flag->str, flag->length));
+        }
+    }
+
+    return NULL;
+}
+
+int CapInternalSpecApply(Cap_Option* option, char* value) {
+    if(option->handler) {
+        return option->handler(option, value) == 0 ? CAP_SPEC_HANDLED : CAP_SPEC_REJECTED;
+    }
+
+    // Without a handler options with values store them and the other ones count occurrences
+    if(option->destination) {
+        if(option->hasValue) *(char**)option->destination = value;
+        else *(int*)option->destination += 1;
+    }
+
+    return CAP_SPEC_HANDLED;
+}
+
+int Cap_SpecDispatch(Cap_Spec* spec, Cap_Iterator* iterator, Cap_Item* item) {
+    Cap_Option* option = Cap_SpecFind(spec, item);
+
+    if(!option) return CAP_SPEC_UNKNOWN;
+
+    char* value = item->value.attached;
+
+    if(option->hasValue) {
+        value = Cap_Value(iterator, item);
+
+        if(!value) return CAP_SPEC_NO_VALUE;
+    }
+
+    return CapInternalSpecApply(option, value);
+}
+
+void Cap_CommandsInit(Cap_Commands* commands, Cap_Command** slots, int capacity) {
+    for(int i = 0; i < capacity; i++) slots[i] = NULL;
+
+    commands->slots = slots;
+    commands->capacity = capacity;
+    commands->count = 0;
+}
+
+Cap_Command** CapInternalCommandSlot(Cap_Commands* commands, const char* name, int length, unsigned int hash) {
+    unsigned int mask = (unsigned int)commands->capacity - 1;
+    unsigned int index = hash & mask;
+
+    Cap_Command** slot;
+    while(*(slot = commands->slots + index)) {
+        Cap_Command* command = *slot;
+
+        if(command->hash == hash && command->nameLength == length && strncmp(command->name, name, (size_t)length) == 0) break;
+
+        index = (index + 1) & mask;
+    }
+
+    return slot;
+}
+
+int Cap_CommandsAdd(Cap_Commands* commands, Cap_Command* command) {
+    if(CapInternalTableFull(commands->count, commands->capacity)) return 0;
+
+    command->nameLength = (int)strlen(command->name);
+    command->hash = CapInternalHash(command->name, command->nameLength);
+
+    Cap_Command** slot = CapInternalCommandSlot(commands, command->name, command->nameLength, command->hash);
+    if(*slot) return 0;
+
+    *slot = command;
+    commands->count++;
+
+    return 1;
+}
+
+Cap_Command* Cap_CommandsFind(Cap_Commands* commands, const char* name, int length) {
+    if(commands->count == 0) return NULL;
+
+    return *CapInternalCommandSlot(commands, name, length, CapInternalHash(name, length));
+}
+
+int Cap_CommandsDispatch(Cap_Commands* commands, Cap_Iterator* iterator, Cap_Item* item, void* context, int* result) {
+    if(item->type != CAP_ARG) return 0;
+
+    // Arguments after "--" are never commands. A peek may read past the terminator,
+    // then only the first argument after it is known to follow it
+    if(item->value.arg == iterator->afterTerminator) return 0;
+    if(iterator->optionsEnded && iterator->lookaheadCount == 0) return 0;
+
+    Cap_Command* command = Cap_CommandsFind(commands, item->value.arg, Cap_Length(item));
+    if(!command) return 0;
+
+    Cap_Iterator child;
+    int atArgv = CapInternalAtArgv(iterator);
+
+    if(atArgv) {
+        // The child iterates over the same argv from the first argument after the command name
+        Cap_Init(iterator->argc - iterator->index, iterator->argv + iterator->index, &child);
+#if defined(CAP_RESPONSE_FILES)
+        // The mapped files are handed over, so they are released with the parent
+        child.filesCount = iterator->filesCount;
+        memcpy(child.files, iterator->files, sizeof(Cap_ResponseFile) * (size_t)iterator->filesCount);
+        child.mappings = iterator->mappings;
+#if defined(CAP_ARENA)
+        child.arena = iterator->arena;
+#endif // CAP_ARENA
+#endif // CAP_RESPONSE_FILES
+#if defined(CAP_STATS)
+        // The child counts on top of the parent, so the parent ends up with the stats of the whole command line
+        child.stats = iterator->stats;
+        child.trace = iterator->trace;
+        child.traceContext = iterator->traceContext;
+#endif // CAP_STATS
+    } else {
+        // Peeked items or an open response file belong to the parent, so the child continues its state
+        child = *iterator;
+    }
+
+    int status = command->handler(command, &child, context);
+    if(result) *result = status;
+
+#if defined(CAP_RESPONSE_FILES)
+    iterator->filesCount = child.filesCount;
+    memcpy(iterator->files, child.files, sizeof(Cap_ResponseFile) * (size_t)child.filesCount);
+    iterator->mappings = child.mappings;
+    iterator->currentFile = -1;
+    while(iterator->filesCount) CapInternalCloseResponseFile(iterator);
+#endif // CAP_RESPONSE_FILES
+
+#if defined(CAP_CONFIG_FILES)
+    iterator->config = NULL;
+#endif // CAP_CONFIG_FILES
+
+#if defined(CAP_STATS)
+    iterator->stats = child.stats;
+#endif // CAP_STATS
+
+    // The rest of the arguments belongs to the command
+    iterator->index = iterator->argc;
+    iterator->mergedFlagsCursor = NULL;
+    iterator->lookaheadCount = 0;
+
+    return 1;
+}
+
+void Cap_TrieInit(Cap_Trie* trie, Cap_TrieNode* nodes, int capacity) {
+    trie->nodes = nodes;
+    trie->capacity = capacity;
+    trie->count = 0;
+
+    if(capacity <= 0) return;
+
+    // The root is the empty prefix
+    nodes[0] = (Cap_TrieNode){ .child = -1, .sibling = -1, .id = -1, .count = 0, .last = -1, .ch = '\0' };
+    trie->count = 1;
+}
+
+// Returns the child of the node with the char or the place where it should be linked
+int* CapInternalTrieChild(Cap_TrieNode* nodes, int node, unsigned char ch) {
+    int* link = &nodes[node].child;
+
+    while(*link >= 0 && (unsigned char)nodes[*link].ch < ch) link = &nodes[*link].sibling;
+
+    return link;
+}
+
+int Cap_TrieAdd(Cap_Trie* trie, const char* name, int id) {
+    if(trie->count == 0 || !name[0]) return 0;
+
+    Cap_TrieNode* nodes = trie->nodes;
+    int length = (int)strlen(name);
+
+    // The existing part of the path is walked first, so a name that doesn't fit changes nothing
+    int node = 0;
+    int depth = 0;
+    for(; depth < length; depth++) {
+        int child = *CapInternalTrieChild(nodes, node, (unsigned char)name[depth]);
+
+        if(child < 0 || nodes[child].ch != name[depth]) break;
+
+        node = child;
+    }
+
+    if(depth == length && nodes[node].id >= 0) return 0;
+    if(trie->count + length - depth > trie->capacity) return 0;
+
+    for(; depth < length; depth++) {
+        int* link = CapInternalTrieChild(nodes, node, (unsigned char)name[depth]);
+        int child = trie->count++;
+
+        nodes[child] = (Cap_TrieNode){ .child = -1, .sibling = *link, .id = -1, .count = 0, .last = -1, .ch = name[depth] };
+        *link = child;
+        node = child;
+    }
+
+    nodes[node].id = id;
+
+    node = 0;
+    for(depth = 0; ; depth++) {
+        nodes[node].count++;
+        nodes[node].last = id;
+
+        if(depth == length) break;
+
+        node = *CapInternalTrieChild(nodes, node, (unsigned char)name[depth]);
+    }
+
+    return 1;
+}
+
+int Cap_TrieFind(const Cap_Trie* trie, const char* str, int length, Cap_TrieMatch* match) {
+    const Cap_TrieNode* nodes = trie->nodes;
+
+    match->type = CAP_TRIE_NONE;
+    match->id = -1;
+    match->node = -1;
+    match->count = 0;
+
+    if(trie->count == 0 || length <= 0) return CAP_TRIE_NONE;
+
+    // One step per char, the cost doesn't depend on the number of names
+    int node = 0;
+    for(int i = 0; i < length; i++) {
+        unsigned char ch = (unsigned char)str[i];
+        int child = nodes[node].child;
+
+        while(child >= 0 && (unsigned char)nodes[child].ch < ch) child = nodes[child].sibling;
+
+        if(child < 0 || (unsigned char)nodes[child].ch != ch) return CAP_TRIE_NONE;
+
+        node = child;
+    }
+
+    match->node = node;
+    match->count = nodes[node].count;
+
+    if(nodes[node].id >= 0) {
+        match->type = CAP_TRIE_EXACT;
+        match->id = nodes[node].id;
+    } else if(nodes[node].count == 1) {
+        match->type = CAP_TRIE_PREFIX;
+        match->id = nodes[node].last;
+    } else {
+        match->type = CAP_TRIE_AMBIGUOUS;
+    }
+
+    return match->type;
+}
+
+int CapInternalTrieCollect(const Cap_TrieNode* nodes, int node, int* ids, int capacity, int count) {
+    if(nodes[node].id >= 0 && count < capacity) ids[count++] = nodes[node].id;
+
+    for(int child = nodes[node].child; child >= 0 && count < capacity; child = nodes[child].sibling) {
+        count = CapInternalTrieCollect(nodes, child, ids, capacity, count);
+    }
+
+    return count;
+}
+
+int Cap_TrieCandidates(const Cap_Trie* trie, const Cap_TrieMatch* match, int* ids, int capacity) {
+    if(match->node < 0) return 0;
+
+    return CapInternalTrieCollect(trie->nodes, match->node, ids, capacity, 0);
+}
+
+// Maps Cap_To*() statuses to the CAP_SPEC_* ones for CAP_DEFINE_OPTIONS
+int CapInternalOptionStatus(int status) {
+    if(status == CAP_VALUE_OK) return CAP_SPEC_HANDLED;
+    if(status == CAP_VALUE_MISSING) return CAP_SPEC_NO_VALUE;
+
+    return CAP_SPEC_REJECTED;
+}
+
+int CapInternalOptionString(char* value, char** destination) {
+    if(!value) return CAP_SPEC_NO_VALUE;
+
+    *destination = value;
+
+    return CAP_SPEC_HANDLED;
+}
+
+// Flag names are matched with variable names in their environment form: "pool-size" -> "POOL_SIZE"
+#define CAP_INTERNAL_ENV_CHAR(CH) ((CH) == '-' ? '_' : (CH) >= 'a' && (CH) <= 'z' ? (CH) - 'a' + 'A' : (CH))
+
+int Cap_EnvInit(Cap_Env* env, char* prefix, char** envp, Cap_EnvEntry* entries, int capacity) {
+    env->entries = entries;
+    env->capacity = capacity;
+    env->count = 0;
+
+    for(int i = 0; i < capacity; i++) entries[i].name = NULL;
+
+    int prefixLength = (int)strlen(prefix);
+    unsigned int mask = (unsigned int)capacity - 1;
+
+    for(; *envp; envp++) {
+        char* variable = *envp;
+
+        if(strncmp(variable, prefix, (size_t)prefixLength) != 0) continue;
+
+        char* name = variable + prefixLength;
+        int length = (int)CAP_STR_CSPN(name, "=");
+
+        if(!name[length]) continue;
+
+        if(CapInternalTableFull(env->count, capacity)) return 0;
+
+        unsigned int hash = CapInternalHash(name, length);
+        unsigned int index = hash & mask;
+
+        Cap_EnvEntry* entry;
+        while((entry = entries + index)->name) {
+            if(entry->hash == hash && entry->length == length && strncmp(entry->name, name, (size_t)length) == 0) break;
+
+            index = (index + 1) & mask;
+        }
+
+        // The first definition wins, the same way as with getenv()
+        if(entry->name) continue;
+
+        entry->name = name;
+        entry->length = length;
+        entry->hash = hash;
+        env->count++;
+    }
+
+    return 1;
+}
+
+char* CapInternalEnvFind(Cap_Env* env, const char* name, int length) {
+    if(env->count == 0) return NULL;
+
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < length; i++) hash = CAP_INTERNAL_HASH_STEP(hash, CAP_INTERNAL_ENV_CHAR(name[i]));
+
+    unsigned int mask = (unsigned int)env->capacity - 1;
+    unsigned int index = hash & mask;
+
+    for(Cap_EnvEntry* entry; (entry = env->entries + index)->name; index = (index + 1) & mask) {
+        if(entry->hash != hash || entry->length != length) continue;
+
+        int i = 0;
+        while(i < length && entry->name[i] == CAP_INTERNAL_ENV_CHAR(name[i])) i++;
+
+        if(i == length) return entry->name + length + 1;
+    }
+
+    return NULL;
+}
+
+char* Cap_EnvValue(Cap_Env* env, char* name) {
+    return CapInternalEnvFind(env, name, (int)strlen(name));
+}
+
+int Cap_EnvItem(Cap_Env* env, char* name, Cap_Item* item) {
+    int length = (int)strlen(name);
+    char* value = CapInternalEnvFind(env, name, length);
+
+    if(!value) {
+        item->type = CAP_NONE;
+        return 0;
+    }
+
+    item->type = CAP_LONG_FLAG;
+    item->value.longFlag.str = name;
+    item->value.longFlag.length = length;
+    item->value.longFlag.terminated = 0;
+    item->value.longFlag.attached = value[0] ? value : NULL;
+    item->length = length;
+    item->attachedLength = value[0] ? -1 : 0;
+    item->index = -1;
+    item->offset = 0;
+
+    return 1;
+}
+
+int Cap_MergeInit(Cap_Merge* merge, Cap_Spec* spec, unsigned long long* bitmaps, int words) {
+    merge->spec = spec;
+    merge->sourcesCount = 0;
+    merge->current = 0;
+    merge->slot = 0;
+    merge->source = NULL;
+    merge->option = NULL;
+
+    int needed = CAP_MERGE_WORDS(spec->ids);
+    if(needed > words) return 0;
+
+    for(int i = 0; i < needed; i++) bitmaps[i] = 0;
+
+    merge->words = needed / 2;
+    merge->seen = bitmaps;
+    merge->taken = bitmaps + merge->words;
+
+    return 1;
+}
+
+// Sources are kept sorted by priority, the ones with the same priority keep the order they were added in
+int CapInternalMergeAdd(Cap_Merge* merge, Cap_Iterator* iterator, Cap_Env* env, int priority) {
+    if(merge->sourcesCount >= CAP_MERGE_SOURCES_MAX) return 0;
+
+    int i = merge->sourcesCount++;
+
+    for(; i > 0 && merge->sources[i - 1].priority < priority; i--) {
+        merge->sources[i] = merge->sources[i - 1];
+    }
+
+    merge->sources[i].iterator = iterator;
+    merge->sources[i].env = env;
+    merge->sources[i].priority = priority;
+
+    return 1;
+}
+
+int Cap_MergeIterator(Cap_Merge* merge, Cap_Iterator* iterator, int priority) {
+    return CapInternalMergeAdd(merge, iterator, NULL, priority);
+}
+
+int Cap_MergeEnv(Cap_Merge* merge, Cap_Env* env, int priority) {
+    return CapInternalMergeAdd(merge, NULL, env, priority);
+}
+
+#define CAP_INTERNAL_MERGE_HAS(BITMAP, ID) (((BITMAP)[(ID) >> 6] >> ((ID) & 63)) & 1)
+#define CAP_INTERNAL_MERGE_ADD(BITMAP, ID) ((BITMAP)[(ID) >> 6] |= 1ull << ((ID) & 63))
+
+int CapInternalMergeIterator(Cap_Merge* merge, Cap_Iterator* iterator, Cap_Item* item) {
+    while(Cap_Next(iterator, item)) {
+        Cap_Option* option = Cap_SpecFind(merge->spec, item);
+
+        // Options added to the spec after Cap_MergeInit() have no bits, so they are unknown to the merge
+        if(option && option->id >= merge->words * 64) option = NULL;
+
+        merge->option = option;
+
+        // General args and unknown flags are passed through
+        if(!option) return 1;
+
+        int separateValue = option->hasValue && !item->value.attached;
+
+        if(CAP_INTERNAL_MERGE_HAS(merge->seen, option->id)) {
+            // The value of a skipped option is consumed too, so it isn't taken for a general arg
+            if(separateValue) Cap_Value(iterator, item);
+            continue;
+        }
+
+        CAP_INTERNAL_MERGE_ADD(merge->taken, option->id);
+
+        // The value is attached to the item, so it is dispatched without the iterator
+        if(separateValue) {
+            char* value = Cap_Value(iterator, item);
+            if(value) CapInternalAttach(item, value);
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// The environment is not iterated, every option that is still missing is looked up in it instead
+int CapInternalMergeEnv(Cap_Merge* merge, Cap_Env* env, Cap_Item* item) {
+    if(env->count == 0) return 0;
+
+    while(merge->slot < merge->spec->capacity) {
+        Cap_Option* option = merge->spec->longFlags[merge->slot++];
+
+        if(!option || option->id >= merge->words * 64 || CAP_INTERNAL_MERGE_HAS(merge->seen, option->id)) continue;
+        if(!Cap_EnvItem(env, option->name, item)) continue;
+
+        CAP_INTERNAL_MERGE_ADD(merge->taken, option->id);
+        merge->option = option;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// Options of a finished source are taken for good, the next sources only fill the gaps
+void CapInternalMergeAdvance(Cap_Merge* merge) {
+    for(int i = 0; i < merge->words; i++) {
+        merge->seen[i] |= merge->taken[i];
+        merge->taken[i] = 0;
+    }
+
+    merge->current++;
+    merge->slot = 0;
+}
+
+int Cap_MergeNext(Cap_Merge* merge, Cap_Item* item) {
+    while(merge->current < merge->sourcesCount) {
+        Cap_MergeSource* source = merge->sources + merge->current;
+        merge->source = source;
+
+        int found = source->iterator
+            ? CapInternalMergeIterator(merge, source->iterator, item)
+            : CapInternalMergeEnv(merge, source->env, item);
+
+        if(found) return 1;
+
+        CapInternalMergeAdvance(merge);
+    }
+
+    merge->source = NULL;
+    merge->option = NULL;
+    item->type = CAP_NONE;
+
+    return 0;
+}
+
+int Cap_MergeDispatch(Cap_Merge* merge, Cap_Item* item) {
+    Cap_Option* option = merge->option;
+
+    if(!option) return CAP_SPEC_UNKNOWN;
+
+    char* value = item->value.attached;
+
+    if(option->hasValue && !value) return CAP_SPEC_NO_VALUE;
+
+    return CapInternalSpecApply(option, value);
+}
+
+Cap_IndexKey* CapInternalIndexSlot(const Cap_Index* index, const char* name, int length, unsigned int hash) {
+    unsigned int mask = (unsigned int)index->capacity - 1;
+    unsigned int position = hash & mask;
+
+    Cap_IndexKey* key;
+    while((key = index->longFlags + position)->name) {
+        if(key->hash == hash && key->length == length && strncmp(key->name, name, (size_t)length) == 0) break;
+
+        position = (position + 1) & mask;
+    }
+
+    return key;
+}
+
+int Cap_IndexInit(Cap_Index* index, Cap_Iterator* iterator, Cap_IndexKey* keys, int capacity, Cap_IndexValue* values, int valuesCapacity) {
+    for(int i = 0; i < 256; i++) {
+        index->flags[i].first = index->flags[i].last = -1;
+        index->flags[i].count = 0;
+    }
+    for(int i = 0; i < capacity; i++) keys[i].name = NULL;
+
+    index->longFlags = keys;
+    index->capacity = capacity;
+    index->count = 0;
+    index->values = values;
+    index->valuesCapacity = valuesCapacity;
+    index->valuesCount = 0;
+
+    Cap_Item item;
+    while(Cap_Next(iterator, &item)) {
+        Cap_IndexFlag* flag;
+
+        if(item.type == CAP_ARG) continue;
+
+        if(item.type == CAP_FLAG) {
+            flag = index->flags + (unsigned char)item.value.flag.ch;
+        } else {
+            Cap_LongFlag* longFlag = &item.value.longFlag;
+            unsigned int hash = CapInternalHash(longFlag->str, longFlag->length);
+
+            Cap_IndexKey* key = capacity ? CapInternalIndexSlot(index, longFlag->str, longFlag->length, hash) : NULL;
+
+            if(!key || !key->name) {
+                if(CapInternalTableFull(index->count, capacity)) return 0;
+
+                key->name = longFlag->str;
+                key->length = longFlag->length;
+                key->hash = hash;
+                key->flag.first = key->flag.last = -1;
+                key->flag.count = 0;
+
+                index->count++;
+            }
+
+            flag = &key->flag;
+        }
+
+        if(index->valuesCount == valuesCapacity) return 0;
+
+        // Same rules as Cap_Value(): the attached value or the next plain argument, which isn't consumed
+        Cap_Item next;
+        char* value = item.value.attached;
+        if(!value && item.index >= 0 && Cap_Check(iterator, &next) && next.type == CAP_ARG && next.value.arg != iterator->afterTerminator) {
+            value = next.value.arg;
+        }
+
+        int position = index->valuesCount++;
+        values[position].value = value;
+        values[position].next = -1;
+
+        if(flag->last < 0) {
+            flag->first = position;
+        } else {
+            values[flag->last].next = position;
+        }
+
+        flag->last = position;
+        flag->count++;
+    }
+
+    return 1;
+}
+
+const Cap_IndexFlag* CapInternalIndexFind(const Cap_Index* index, const char* flag) {
+    if(flag[0] != '-') return NULL;
+
+    if(flag[1] != '-') return index->flags + (unsigned char)flag[1];
+
+    if(index->count == 0) return NULL;
+
+    int length = (int)strlen(flag + 2);
+    Cap_IndexKey* key = CapInternalIndexSlot(index, flag + 2, length, CapInternalHash(flag + 2, length));
+
+    return key->name ? &key->flag : NULL;
+}
+
+int Cap_IndexCount(const Cap_Index* index, const char* flag) {
+    const Cap_IndexFlag* found = CapInternalIndexFind(index, flag);
+
+    return found ? found->count : 0;
+}
+
+char* Cap_IndexLast(const Cap_Index* index, const char* flag) {
+    const Cap_IndexFlag* found = CapInternalIndexFind(index, flag);
+
+    if(!found || found->last < 0) return NULL;
+
+    return index->values[found->last].value;
+}
+
+int Cap_IndexValues(const Cap_Index* index, const char* flag, char** values, int capacity) {
+    const Cap_IndexFlag* found = CapInternalIndexFind(index, flag);
+
+    if(!found) return 0;
+
+    int count = 0;
+    for(int position = found->first; position >= 0; position = index->values[position].next) {
+        if(!index->values[position].value) continue;
+
+        if(count < capacity) values[count] = index->values[position].value;
+        count++;
+    }
+
+    return count;
+}
+
+#define CAP_INTERNAL_LFLAG_TABLE_EMPTY 0
+#define CAP_INTERNAL_LFLAG_TABLE_READY 1
+#define CAP_INTERNAL_LFLAG_TABLE_OVERFLOW 2
+
+int CapInternalLFlagFind(CapInternalLFlagTable* table, Cap_LongFlag* flag) {
+    switch(table->state) {
+        case CAP_INTERNAL_LFLAG_TABLE_EMPTY:
+            return CAP_INTERNAL_LFLAG_BUILD;
+
+        case CAP_INTERNAL_LFLAG_TABLE_OVERFLOW:
+            return CAP_INTERNAL_LFLAG_LINEAR;
+    }
+
+    unsigned int mask = CAP_HASHED_LFLAGS_SIZE - 1;
+    unsigned int index = CapInternalHash(flag->str, flag->length) & mask;
+
+    CapInternalLFlagSlot* slot;
+    while((slot = table->slots + index)->name) {
+        if(slot->length == flag->length && CAP_STRN_CMP(slot->name, flag->str, flag->length) == 0) {
+            return slot->id;
+        }
+
+        index = (index + 1) & mask;
+    }
+
+    return CAP_INTERNAL_LFLAG_UNKNOWN;
+}
+
+void CapInternalLFlagAdd(CapInternalLFlagTable* table, const char* name, int id) {
+    if(table->state != CAP_INTERNAL_LFLAG_TABLE_EMPTY) return;
+
+    // Names that don't fit fall back to linear matching
+    if(CapInternalTableFull(table->count, CAP_HASHED_LFLAGS_SIZE)) {
+        table->state = CAP_INTERNAL_LFLAG_TABLE_OVERFLOW;
+        return;
+    }
+
+    int length = 0;
+    while(name[length]) length++;
+
+    unsigned int mask = CAP_HASHED_LFLAGS_SIZE - 1;
+    unsigned int index = CapInternalHash(name, length) & mask;
+
+    CapInternalLFlagSlot* slot;
+    while((slot = table->slots + index)->name) {
+        // The first declaration wins, the same way it does with linear matching
+        if(slot->length == length && CAP_STRN_CMP(slot->name, name, length) == 0) return;
+
+        index = (index + 1) & mask;
+    }
+
+    slot->name = name;
+    slot->length = length;
+    slot->id = id;
+    table->count++;
+}
+
+int CapInternalLFlagSeal(CapInternalLFlagTable* table, Cap_LongFlag* flag, int* id) {
+    if(*id != CAP_INTERNAL_LFLAG_BUILD) return 0;
+
+    if(table->state == CAP_INTERNAL_LFLAG_TABLE_EMPTY) {
+        table->state = CAP_INTERNAL_LFLAG_TABLE_READY;
+    }
+
+    *id = CapInternalLFlagFind(table, flag);
+
+    return 1;
+}
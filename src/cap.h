@@ -8,6 +8,13 @@
     #define CAP_STRN_CMP strncmp
 #endif // CAP_STR_CMP
 
+#if !defined(CAP_STR_CSPN)
+    #include <string.h>
+    #define CAP_STR_CSPN strcspn
+#endif // CAP_STR_CSPN
+
+#include <stddef.h>
+
 #define CAP_NONE -1
 #define CAP_FLAG 0
 #define CAP_LONG_FLAG 1
@@ -36,23 +43,504 @@ typedef union Cap_ItemValue {
 typedef struct Cap_Item {
     int type;
     Cap_ItemValue value;
+
+    int length; // argument length for CAP_ARG, name length for CAP_LONG_FLAG and 1 for CAP_FLAG, -1 until Cap_Length() measures an arg
+    int attachedLength; // length of value.attached, 0 without it and -1 until Cap_ValueView() measures it
+    int index; // argv index of the argument or -1
+    int offset; // offset of the flag char, the long flag name or the argument in argv[index]
 } Cap_Item;
 
+#if defined(CAP_RESPONSE_FILES)
+
+#if !defined(CAP_RESPONSE_FILES_MAX)
+    #define CAP_RESPONSE_FILES_MAX 16
+#endif // CAP_RESPONSE_FILES_MAX
+
+typedef struct Cap_ResponseFile {
+    char* data;
+    size_t size;
+    char* cursor;
+    char* next;
+    int parent;
+    unsigned long long device;
+    unsigned long long inode;
+} Cap_ResponseFile;
+
+// Written to the zeroed tail of the mapping once its file is read to the end, so the slot can be reused
+typedef struct Cap_ResponseMapping {
+    struct Cap_ResponseMapping* previous;
+    size_t size; // mapped size
+} Cap_ResponseMapping;
+
+#endif // CAP_RESPONSE_FILES
+
+#if defined(CAP_ARENA)
+
+#if !defined(CAP_ARENA_CHUNK_SIZE)
+    #define CAP_ARENA_CHUNK_SIZE (64 * 1024)
+#endif // CAP_ARENA_CHUNK_SIZE
+
+#if !defined(CAP_ARENA_ALIGN)
+    #define CAP_ARENA_ALIGN 16
+#endif // CAP_ARENA_ALIGN
+
+typedef struct Cap_ArenaChunk {
+    struct Cap_ArenaChunk* previous;
+    size_t size; // mapped size including the header
+} Cap_ArenaChunk;
+
+typedef struct Cap_Arena {
+    char* buffer; // block the allocations are carved from
+    size_t capacity;
+    size_t used;
+    char* initial; // caller-supplied buffer
+    size_t initialCapacity;
+    Cap_ArenaChunk* chunks; // mapped chunks, the last one first
+} Cap_Arena;
+
+#endif // CAP_ARENA
+
+#if defined(CAP_CONFIG_FILES)
+
+typedef struct Cap_Config {
+    char* data;
+    size_t size; // mapped size or 0 if the text belongs to the caller
+    char* cursor;
+    char* section; // name of the current [section] or NULL
+    int line; // line of the last entry
+} Cap_Config;
+
+#endif // CAP_CONFIG_FILES
+
+#if defined(CAP_STATS)
+
+typedef struct Cap_Stats {
+    unsigned long items; // items read by Cap_Next()
+    unsigned long checks; // items read by Cap_Check() or Cap_Peek()
+    unsigned long parses; // arguments parsed
+    unsigned long merged; // items read from merged flags(-abc)
+    unsigned long compares; // CAP_STRN_CMP() calls made by CAP_MATCH_LFLAG
+    unsigned long lookups; // hash table lookups made by CAP_LONG_FLAGS in the hashed mode
+} Cap_Stats;
+
+struct Cap_Iterator;
+
+typedef void Cap_TraceHook(struct Cap_Iterator* iterator, Cap_Item* item, int isDry, void* context);
+
+#define CAP_INTERNAL_STAT(ITERATOR, COUNTER) ((ITERATOR)->stats.COUNTER++)
+
+#else
+
+#define CAP_INTERNAL_STAT(ITERATOR, COUNTER) ((void)0)
+
+#endif // CAP_STATS
+
+#if !defined(CAP_LOOKAHEAD_SIZE)
+    #define CAP_LOOKAHEAD_SIZE 4
+#endif // CAP_LOOKAHEAD_SIZE
+
 typedef struct Cap_Iterator {
     int argc;
     char** argv;
     int index;
     char* mergedFlagsCursor;
+    char* mergedFlagsBase;
+    int lookaheadStart;
+    int lookaheadCount;
+    int optionsEnded; // set after "--", the following arguments are read as CAP_ARG
+    char* afterTerminator; // first argument after "--", it is never taken as a value
+    Cap_Item lookahead[CAP_LOOKAHEAD_SIZE];
+#if defined(CAP_RESPONSE_FILES)
+    int filesCount;
+    int currentFile;
+    Cap_ResponseFile files[CAP_RESPONSE_FILES_MAX]; // files being read, each one nested in the previous
+    Cap_ResponseMapping* mappings; // mappings of the finished files, the last one first
+#if defined(CAP_ARENA)
+    Cap_Arena* arena; // response files are read into it instead of being mapped
+#endif // CAP_ARENA
+#endif // CAP_RESPONSE_FILES
+#if defined(CAP_CONFIG_FILES)
+    Cap_Config* config; // its entries are read before the arguments
+    int configIndex; // argv index the arguments continue from after the config
+#endif // CAP_CONFIG_FILES
+#if defined(CAP_STATS)
+    Cap_Stats stats;
+    Cap_TraceHook* trace;
+    void* traceContext;
+#endif // CAP_STATS
 } Cap_Iterator;
 
+#if !defined(CAP_STREAM_BUFFER_SIZE)
+    #define CAP_STREAM_BUFFER_SIZE 1024
+#endif // CAP_STREAM_BUFFER_SIZE
+
+typedef struct Cap_Stream {
+    char* chunk;
+    size_t chunkLength;
+    char* mergedFlagsCursor;
+    char* mergedFlagsBase;
+    int index;
+    int length;
+    int overflow;
+    char buffer[CAP_STREAM_BUFFER_SIZE];
+} Cap_Stream;
+
+typedef struct Cap_Utf8Error {
+    int index; // argv index of the first invalid argument or -1
+    int offset; // offset of the first invalid sequence in argv[index]
+} Cap_Utf8Error;
+
+typedef struct Cap_Tokens {
+    int capacity;
+    int length;
+
+    signed char* types;
+    int* indexes;
+    int* offsets;
+    int* lengths;
+    int* attached;
+    Cap_Utf8Error* utf8; // the arguments are validated as UTF-8 if it is set
+} Cap_Tokens;
+
+typedef struct Cap_FlagSet {
+    unsigned long long seen[4];
+    int counts[256];
+} Cap_FlagSet;
+
+typedef struct Cap_Option Cap_Option;
+
+typedef int Cap_OptionHandler(Cap_Option* option, char* value);
+
+struct Cap_Option {
+    char* name;
+    char ch;
+    int hasValue;
+    Cap_OptionHandler* handler;
+    void* destination;
+
+    // Filled by Cap_SpecAdd()
+    int nameLength;
+    unsigned int hash;
+    int id; // order of the option in the spec
+};
+
+typedef struct Cap_Spec {
+    Cap_Option* flags[256];
+    Cap_Option** longFlags;
+    int capacity;
+    int count;
+    int ids; // number of options, including the ones without a long name
+} Cap_Spec;
+
+typedef struct Cap_OptionDoc {
+    char ch;
+    char* name;
+    char* help;
+} Cap_OptionDoc;
+
+typedef struct Cap_Command Cap_Command;
+
+typedef int Cap_CommandHandler(Cap_Command* command, Cap_Iterator* iterator, void* context);
+
+struct Cap_Command {
+    char* name;
+    Cap_CommandHandler* handler;
+    void* data;
+
+    // Filled by Cap_CommandsAdd()
+    int nameLength;
+    unsigned int hash;
+};
+
+typedef struct Cap_Commands {
+    Cap_Command** slots;
+    int capacity;
+    int count;
+} Cap_Commands;
+
+typedef struct Cap_TrieNode {
+    int child; // first child or -1
+    int sibling; // next child of the parent, the children are sorted by char
+    int id; // id of the name ending here or -1
+    int count; // number of names in the subtree
+    int last; // id of the last name added to the subtree
+    char ch;
+} Cap_TrieNode;
+
+typedef struct Cap_Trie {
+    Cap_TrieNode* nodes;
+    int capacity;
+    int count;
+} Cap_Trie;
+
+#define CAP_TRIE_NONE 0
+#define CAP_TRIE_EXACT 1
+#define CAP_TRIE_PREFIX 2
+#define CAP_TRIE_AMBIGUOUS 3
+
+typedef struct Cap_TrieMatch {
+    int type;
+    int id; // matched id or -1
+    int node; // node of the typed prefix or -1
+    int count; // number of names starting with the prefix
+} Cap_TrieMatch;
+
+#define CAP_VALUE_OK 0
+#define CAP_VALUE_MISSING 1
+#define CAP_VALUE_INVALID 2
+#define CAP_VALUE_RANGE 3
+
+#define CAP_SPEC_HANDLED 1
+#define CAP_SPEC_UNKNOWN 0
+#define CAP_SPEC_NO_VALUE -1
+#define CAP_SPEC_REJECTED -2
+
+typedef struct Cap_EnvEntry {
+    char* name;
+    int length;
+    unsigned int hash;
+} Cap_EnvEntry;
+
+typedef struct Cap_Env {
+    Cap_EnvEntry* entries;
+    int capacity;
+    int count;
+} Cap_Env;
+
+#if !defined(CAP_MERGE_SOURCES_MAX)
+    #define CAP_MERGE_SOURCES_MAX 8
+#endif // CAP_MERGE_SOURCES_MAX
+
+typedef struct Cap_MergeSource {
+    Cap_Iterator* iterator; // arguments, config or response files
+    Cap_Env* env; // environment, used if there is no iterator
+    int priority;
+} Cap_MergeSource;
+
+typedef struct Cap_Merge {
+    Cap_Spec* spec;
+    unsigned long long* seen; // options taken from the previous sources
+    unsigned long long* taken; // options taken from the current source
+    int words; // size of each bitmap
+    int sourcesCount;
+    int current;
+    int slot; // next long flag slot of the spec for environment sources
+    Cap_MergeSource* source; // source of the last item
+    Cap_Option* option; // option of the last item or NULL
+    Cap_MergeSource sources[CAP_MERGE_SOURCES_MAX];
+} Cap_Merge;
+
+typedef struct Cap_IndexValue {
+    char* value;
+    int next;
+} Cap_IndexValue;
+
+typedef struct Cap_IndexFlag {
+    int first;
+    int last;
+    int count;
+} Cap_IndexFlag;
+
+typedef struct Cap_IndexKey {
+    char* name;
+    int length;
+    unsigned int hash;
+    Cap_IndexFlag flag;
+} Cap_IndexKey;
+
+typedef struct Cap_Index {
+    Cap_IndexFlag flags[256];
+    Cap_IndexKey* longFlags;
+    int capacity;
+    int count;
+    Cap_IndexValue* values;
+    int valuesCapacity;
+    int valuesCount;
+} Cap_Index;
+
+#if defined(CAP_PROC_SCANNER)
+
+typedef int Cap_ProcessCallback(int pid, int argc, char** argv, Cap_Tokens* tokens, void* context);
+
+typedef struct Cap_ProcessScanner {
+    char* buffer;
+    size_t bufferSize;
+    char** argv;
+    int argvCapacity;
+    Cap_Tokens tokens;
+} Cap_ProcessScanner;
+
+#endif // CAP_PROC_SCANNER
+
+#if !defined(CAP_HASHED_LFLAGS_SIZE)
+    #define CAP_HASHED_LFLAGS_SIZE 512
+#endif // CAP_HASHED_LFLAGS_SIZE
+
+// Long flags table used by CAP_LONG_FLAGS when CAP_HASHED_LFLAGS is defined
+typedef struct CapInternalLFlagSlot {
+    const char* name;
+    int length;
+    int id;
+} CapInternalLFlagSlot;
+
+typedef struct CapInternalLFlagTable {
+    int state;
+    int count;
+    CapInternalLFlagSlot slots[CAP_HASHED_LFLAGS_SIZE];
+} CapInternalLFlagTable;
+
 // Functions
 void Cap_Init(int argc, char** argv, struct Cap_Iterator* iterator);
+void Cap_Release(Cap_Iterator* iterator);
 int Cap_Next(Cap_Iterator* iterator, Cap_Item* item);
 int Cap_Check(Cap_Iterator* iterator, Cap_Item* item);
+int Cap_Peek(Cap_Iterator* iterator, int k, Cap_Item* item);
+int Cap_Rest(Cap_Iterator* iterator, int* argc, char*** argv);
 
+int Cap_Length(Cap_Item* item);
 char* Cap_Value(Cap_Iterator* iterator, Cap_Item* item);
+char* Cap_ValueView(Cap_Iterator* iterator, Cap_Item* item, int* length);
+
+#if defined(CAP_STATS)
+void Cap_Trace(Cap_Iterator* iterator, Cap_TraceHook* hook, void* context);
+#endif // CAP_STATS
 void Cap_Parse(char* arg, Cap_Item* result);
 
+int Cap_ToInt(char* str, long long* result);
+int Cap_ToU64(char* str, unsigned long long* result);
+int Cap_ToDouble(char* str, double* result);
+int Cap_ToSize(char* str, unsigned long long* result);
+int Cap_ToDuration(char* str, unsigned long long* result);
+
+int Cap_ValueInt(Cap_Iterator* iterator, Cap_Item* item, long long* result);
+int Cap_ValueU64(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result);
+int Cap_ValueDouble(Cap_Iterator* iterator, Cap_Item* item, double* result);
+int Cap_ValueSize(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result);
+int Cap_ValueDuration(Cap_Iterator* iterator, Cap_Item* item, unsigned long long* result);
+
+int Cap_Tokenize(int argc, char** argv, Cap_Tokens* tokens);
+int Cap_Utf8Check(const char* str, int length);
+int Cap_Split(char* line, char** argv, int capacity);
+int Cap_ScanFlags(int argc, char** argv, Cap_FlagSet* set);
+
+#if defined(CAP_PARALLEL_TOKENIZE)
+
+#if !defined(CAP_PARALLEL_TOKENIZE_MAX)
+    #define CAP_PARALLEL_TOKENIZE_MAX 64
+#endif // CAP_PARALLEL_TOKENIZE_MAX
+
+// Minimal number of arguments per thread
+#if !defined(CAP_PARALLEL_TOKENIZE_MIN)
+    #define CAP_PARALLEL_TOKENIZE_MIN 4096
+#endif // CAP_PARALLEL_TOKENIZE_MIN
+
+int Cap_TokenizeParallel(int argc, char** argv, Cap_Tokens* tokens, int threads);
+
+#endif // CAP_PARALLEL_TOKENIZE
+
+/**
+ * SET - Cap_FlagSet* - set filled by Cap_ScanFlags()
+ * CH - char - flag
+ * 
+ * Checks whether the flag was seen
+*/
+#define CAP_FLAG_SEEN(SET, CH) ((int)(((SET)->seen[(unsigned char)(CH) >> 6] >> ((unsigned char)(CH) & 63)) & 1))
+
+/**
+ * SET - Cap_FlagSet* - set filled by Cap_ScanFlags()
+ * CH - char - flag
+ * 
+ * Number of times the flag was seen(-vvv is 3)
+*/
+#define CAP_FLAG_COUNT(SET, CH) (CAP_FLAG_SEEN(SET, CH) ? (SET)->counts[(unsigned char)(CH)] : 0)
+
+#if defined(CAP_PROC_SCANNER)
+int Cap_ScanProcesses(Cap_ProcessScanner* scanner, Cap_ProcessCallback* callback, void* context);
+#endif // CAP_PROC_SCANNER
+
+void Cap_SpecInit(Cap_Spec* spec, Cap_Option** slots, int capacity);
+int Cap_SpecAdd(Cap_Spec* spec, Cap_Option* option);
+Cap_Option* Cap_SpecFind(Cap_Spec* spec, Cap_Item* item);
+int Cap_SpecDispatch(Cap_Spec* spec, Cap_Iterator* iterator, Cap_Item* item);
+
+void Cap_CommandsInit(Cap_Commands* commands, Cap_Command** slots, int capacity);
+int Cap_CommandsAdd(Cap_Commands* commands, Cap_Command* command);
+Cap_Command* Cap_CommandsFind(Cap_Commands* commands, const char* name, int length);
+int Cap_CommandsDispatch(Cap_Commands* commands, Cap_Iterator* iterator, Cap_Item* item, void* context, int* result);
+
+void Cap_TrieInit(Cap_Trie* trie, Cap_TrieNode* nodes, int capacity);
+int Cap_TrieAdd(Cap_Trie* trie, const char* name, int id);
+int Cap_TrieFind(const Cap_Trie* trie, const char* str, int length, Cap_TrieMatch* match);
+int Cap_TrieCandidates(const Cap_Trie* trie, const Cap_TrieMatch* match, int* ids, int capacity);
+
+int Cap_EnvInit(Cap_Env* env, char* prefix, char** envp, Cap_EnvEntry* entries, int capacity);
+char* Cap_EnvValue(Cap_Env* env, char* name);
+int Cap_EnvItem(Cap_Env* env, char* name, Cap_Item* item);
+
+/**
+ * OPTIONS - int - number of options in the spec
+ * 
+ * Number of unsigned long long words Cap_MergeInit() needs for the bitmaps
+*/
+#define CAP_MERGE_WORDS(OPTIONS) (((OPTIONS) + 63) / 64 * 2)
+
+int Cap_MergeInit(Cap_Merge* merge, Cap_Spec* spec, unsigned long long* bitmaps, int words);
+int Cap_MergeIterator(Cap_Merge* merge, Cap_Iterator* iterator, int priority);
+int Cap_MergeEnv(Cap_Merge* merge, Cap_Env* env, int priority);
+int Cap_MergeNext(Cap_Merge* merge, Cap_Item* item);
+int Cap_MergeDispatch(Cap_Merge* merge, Cap_Item* item);
+
+int Cap_IndexInit(Cap_Index* index, Cap_Iterator* iterator, Cap_IndexKey* keys, int capacity, Cap_IndexValue* values, int valuesCapacity);
+int Cap_IndexCount(const Cap_Index* index, const char* flag);
+char* Cap_IndexLast(const Cap_Index* index, const char* flag);
+int Cap_IndexValues(const Cap_Index* index, const char* flag, char** values, int capacity);
+
+void Cap_StreamInit(Cap_Stream* stream);
+int Cap_Feed(Cap_Stream* stream, char* chunk, size_t length);
+int Cap_StreamNext(Cap_Stream* stream, Cap_Item* item);
+
+#if defined(CAP_ARENA)
+void Cap_ArenaInit(Cap_Arena* arena, void* buffer, size_t size);
+void* Cap_ArenaAlloc(Cap_Arena* arena, size_t size);
+char* Cap_ArenaString(Cap_Arena* arena, const char* str, int length);
+char** Cap_ArenaSplit(Cap_Arena* arena, const char* line, int* argc);
+void Cap_ArenaRelease(Cap_Arena* arena);
+#if defined(CAP_RESPONSE_FILES)
+void Cap_UseArena(Cap_Iterator* iterator, Cap_Arena* arena);
+#endif // CAP_RESPONSE_FILES
+
+/**
+ * ARENA - Cap_Arena* - arena to allocate from
+ * TYPE - type of the elements
+ * COUNT - number of the elements
+ * 
+ * Allocates an array from the arena, NULL if no memory can be mapped
+*/
+#define CAP_ARENA_ARRAY(ARENA, TYPE, COUNT) ((TYPE*)Cap_ArenaAlloc(ARENA, sizeof(TYPE) * (size_t)(COUNT)))
+#endif // CAP_ARENA
+
+#if defined(CAP_CONFIG_FILES)
+int Cap_ConfigOpen(Cap_Config* config, const char* path);
+void Cap_ConfigInit(Cap_Config* config, char* text);
+int Cap_ConfigNext(Cap_Config* config, Cap_Item* item);
+void Cap_ConfigRelease(Cap_Config* config);
+void Cap_UseConfig(Cap_Iterator* iterator, Cap_Config* config);
+#endif // CAP_CONFIG_FILES
+
+// Internal functions used by the macros
+unsigned int CapInternalHash(const char* str, int length);
+char* CapInternalEnvFind(Cap_Env* env, const char* name, int length);
+const Cap_IndexFlag* CapInternalIndexFind(const Cap_Index* index, const char* flag);
+int CapInternalLFlagFind(CapInternalLFlagTable* table, Cap_LongFlag* flag);
+void CapInternalLFlagAdd(CapInternalLFlagTable* table, const char* name, int id);
+int CapInternalLFlagSeal(CapInternalLFlagTable* table, Cap_LongFlag* flag, int* id);
+int CapInternalOptionStatus(int status);
+int CapInternalOptionString(char* value, char** destination);
+
+#define CAP_INTERNAL_LFLAG_UNKNOWN -1
+#define CAP_INTERNAL_LFLAG_BUILD -2
+#define CAP_INTERNAL_LFLAG_LINEAR -3
+
 // Macros
 /**
  * ARGC - int - number of arguments
@@ -60,7 +548,7 @@ void Cap_Parse(char* arg, Cap_Item* result);
  * ARGS_NAME - Cap_Iterator name
  * ARG_NAME - Cap_Item name
  * 
- * Iterate over the CLI arguments
+ * Iterate over the CLI arguments. The iterator is not released, so mapped response files live until exit
  * 
  * Example:
  * int main(int argc, char** argv) {
@@ -84,6 +572,21 @@ void Cap_Parse(char* arg, Cap_Item* result);
     CAP_FOR_EACH(ARGC, ARGV, CAP_LOCAL_ARGS, CAP_LOCAL_ARG)\
         switch(CAP_LOCAL_ARG.type)
 
+#if defined(CAP_CONFIG_FILES)
+/**
+ * CONFIG - Cap_Config* - config to read first
+ * ARGC - int - number of arguments
+ * ARGV - char** - arguments
+ * 
+ * Same as CAP_PARSE_SWITCH, but the config entries come as long flags before the arguments
+*/
+#define CAP_PARSE_CONFIG_SWITCH(CONFIG, ARGC, ARGV)\
+    for(Cap_Iterator CAP_LOCAL_ARGS, *CAP_ARGS_NAME_LIFETIME = (Cap_Init(ARGC, ARGV, &CAP_LOCAL_ARGS), Cap_UseConfig(&CAP_LOCAL_ARGS, CONFIG), (void*)0x0); CAP_ARGS_NAME_LIFETIME != (void*)0x1;)\
+        for(Cap_Item CAP_LOCAL_ARG; CAP_ARGS_NAME_LIFETIME != (void*)0x1; CAP_ARGS_NAME_LIFETIME = (void*)0x1)\
+            while(Cap_Next(&CAP_LOCAL_ARGS, &CAP_LOCAL_ARG))\
+                switch(CAP_LOCAL_ARG.type)
+#endif // CAP_CONFIG_FILES
+
 /**
  * Only to use inside of CAP_PARSE_SWITCH
  * 
@@ -184,6 +687,111 @@ void Cap_Parse(char* arg, Cap_Item* result);
         continue;\
     }
 
+/**
+ * Only to use inside of CAP_LONG_FLAGS macros
+ * 
+ * Checks that FLAG(Cap_LongFlag) is exactly NAME
+*/
+#define CAP_INTERNAL_LFLAG_EQUALS(FLAG, NAME)\
+    (\
+        (FLAG).str[0] == (NAME)[0]\
+        && (CAP_INTERNAL_STAT(&CAP_LOCAL_ARGS, compares), CAP_STRN_CMP((FLAG).str, NAME, (FLAG).length) == 0)\
+        && (NAME)[(FLAG).length] == '\0'\
+    )
+
+#if defined(CAP_HASHED_LFLAGS)
+
+#if defined(__GNUC__)
+    #define CAP_INTERNAL_FALLTHROUGH __attribute__((fallthrough))
+#else
+    #define CAP_INTERNAL_FALLTHROUGH
+#endif // __GNUC__
+
+/**
+ * Only to use inside of CAP_PARSE_SWITCH
+ * 
+ * Parse string flags(--flag, --value and e.t.c.)
+ * 
+ * Hashed mode: on the first long flag the names of all CAP_MATCH_LFLAG
+ * statements are collected into a static hash table, after that every
+ * flag is resolved with one hash lookup and a jump to its code block.
+ * The table is built lazily without locks, so the first parse
+ * should not run concurrently on several threads.
+ * 
+ * Example:
+ * CAP_LONG_FLAGS(
+ *      CAP_MATCH_LFLAG("value", {
+ *          // ...
+ *      })
+ *      // ...
+ * )
+*/
+#define CAP_LONG_FLAGS(...)\
+    case CAP_LONG_FLAG: {\
+        static CapInternalLFlagTable CAP_LOCAL_LFLAG_TABLE;\
+        CAP_INTERNAL_STAT(&CAP_LOCAL_ARGS, lookups);\
+        int CAP_LOCAL_LFLAG_ID = CapInternalLFlagFind(&CAP_LOCAL_LFLAG_TABLE, &CAP_LOCAL_ARG.value.longFlag);\
+        do switch(CAP_LOCAL_LFLAG_ID) {\
+            default:;\
+            __VA_ARGS__\
+        } while(CapInternalLFlagSeal(&CAP_LOCAL_LFLAG_TABLE, &CAP_LOCAL_ARG.value.longFlag, &CAP_LOCAL_LFLAG_ID));\
+        break;\
+    }
+
+/**
+ * Only to use inside of CAP_LONG_FLAGS
+ * 
+ * Match multi-char flag
+ * 
+ * NAME - char* - flag name
+ * CODE - code block
+ * 
+ * Example:
+ * CAP_LONG_FLAGS(
+ *      CAP_MATCH_LFLAG("value", {
+ *          // ...
+ *      })
+ *      // ...
+ * )
+*/
+#define CAP_MATCH_LFLAG(NAME, CODE) CAP_INTERNAL_MATCH_LFLAG(NAME, CODE, __COUNTER__)
+
+#define CAP_INTERNAL_MATCH_LFLAG(NAME, CODE, ID)\
+    CAP_INTERNAL_FALLTHROUGH;\
+    case ID:\
+        if(\
+            CAP_LOCAL_LFLAG_ID == ID\
+            || (CAP_LOCAL_LFLAG_ID == CAP_INTERNAL_LFLAG_LINEAR && CAP_INTERNAL_LFLAG_EQUALS(CAP_LOCAL_ARG.value.longFlag, NAME))\
+        ) {\
+            CODE\
+            continue;\
+        }\
+        if(CAP_LOCAL_LFLAG_ID == CAP_INTERNAL_LFLAG_BUILD) CapInternalLFlagAdd(&CAP_LOCAL_LFLAG_TABLE, NAME, ID);
+
+/**
+ * Only to use inside of CAP_LONG_FLAGS
+ * 
+ * Handle unmatched long flag
+ * Should go after all other matches
+ * 
+ * NAME - Cap_LongFlag* variable name
+ * CODE - code block
+ * 
+ * Example:
+ * CAP_LONG_FLAGS(
+ *      CAP_UNMATCHED_LFLAGS(name, {
+ *          printf("Unknown flag --%s\n", name->str);
+ *      })
+ * )
+*/
+#define CAP_UNMATCHED_LFLAGS(NAME, CODE)\
+    if(CAP_LOCAL_LFLAG_ID != CAP_INTERNAL_LFLAG_BUILD) {\
+        Cap_LongFlag* NAME = &CAP_LOCAL_ARG.value.longFlag;\
+        CODE\
+    }
+
+#else
+
 /**
  * Only to use inside of CAP_PARSE_SWITCH
  * 
@@ -220,7 +828,7 @@ void Cap_Parse(char* arg, Cap_Item* result);
  * )
 */
 #define CAP_MATCH_LFLAG(NAME, CODE)\
-    if(CAP_STRN_CMP(CAP_LOCAL_ARG.value.longFlag.str, NAME, CAP_LOCAL_ARG.value.longFlag.length) == 0) {\
+    if(CAP_INTERNAL_LFLAG_EQUALS(CAP_LOCAL_ARG.value.longFlag, NAME)) {\
         CODE\
         continue;\
     }
@@ -247,6 +855,8 @@ void Cap_Parse(char* arg, Cap_Item* result);
         CODE\
     }
 
+#endif // CAP_HASHED_LFLAGS
+
 /**
  * Only to use inside of CAP_MATCH_FLAG or CAP_MATCH_LFLAG
  * 
@@ -298,4 +908,113 @@ void Cap_Parse(char* arg, Cap_Item* result);
 */
 #define Cap_getCurrentFlag() CAP_LOCAL_ARG.value.flag.ch
 
+/**
+ * NAME - name of the generated struct and the prefix of the generated functions
+ * LIST - X-macro with the options, every entry is X(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP)
+ *  TYPE - FLAG(int counter), STRING(char*), INT(long long), U64, SIZE, DURATION(unsigned long long) or DOUBLE
+ *  FIELD - struct field name
+ *  CH - single char flag or 0
+ *  LONG_NAME - string literal with the long flag name or ""
+ *  DEFAULT - initial value of the field
+ *  HELP - string literal with the description
+ * 
+ * Generates from one list:
+ *  struct NAME with a field per option, wide fields go first so there is no padding between them
+ *  void NAME##_Init(NAME* options) - sets the defaults
+ *  int NAME##_Dispatch(NAME* options, Cap_Iterator* iterator, Cap_Item* item) - same as Cap_SpecDispatch()
+ *  Cap_OptionDoc NAME##_Docs[] - options for the help text, ends with an entry without help
+ * 
+ * The parser is compiled for exactly these options: single char flags are a switch,
+ * long flags are compared only when the length and the first char match, values are
+ * converted in place. Defines functions, so should be used once in a .c file.
+ * 
+ * Example:
+ * #define APP_OPTIONS(X)\
+ *      X(FLAG, verbose, 'v', "verbose", 0, "Print more")\
+ *      X(INT, jobs, 'j', "jobs", 1, "Number of jobs")
+ * 
+ * CAP_DEFINE_OPTIONS(AppOptions, APP_OPTIONS)
+*/
+#define CAP_DEFINE_OPTIONS(NAME, LIST)\
+    typedef struct NAME {\
+        LIST(CAP_INTERNAL_OPTION_WIDE)\
+        LIST(CAP_INTERNAL_OPTION_NARROW)\
+    } NAME;\
+    \
+    void NAME##_Init(NAME* options);\
+    int NAME##_Dispatch(NAME* options, Cap_Iterator* iterator, Cap_Item* item);\
+    \
+    Cap_OptionDoc NAME##_Docs[] = {\
+        LIST(CAP_INTERNAL_OPTION_DOC)\
+        { '\0', NULL, NULL }\
+    };\
+    \
+    void NAME##_Init(NAME* options) {\
+        LIST(CAP_INTERNAL_OPTION_DEFAULT)\
+    }\
+    \
+    int NAME##_Dispatch(NAME* options, Cap_Iterator* iterator, Cap_Item* item) {\
+        if(item->type == CAP_FLAG) {\
+            int ch = (unsigned char)item->value.flag.ch;\
+            switch(ch) {\
+                LIST(CAP_INTERNAL_OPTION_CASE)\
+                default: break;\
+            }\
+        } else if(item->type == CAP_LONG_FLAG) {\
+            char* str = item->value.longFlag.str;\
+            int length = item->value.longFlag.length;\
+            LIST(CAP_INTERNAL_OPTION_MATCH)\
+            (void)str;\
+            (void)length;\
+        }\
+        (void)options;\
+        (void)iterator;\
+        return CAP_SPEC_UNKNOWN;\
+    }
+
+#define CAP_INTERNAL_OPTION_WIDE(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP) CAP_INTERNAL_OPTION_WIDE_##TYPE(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP) CAP_INTERNAL_OPTION_NARROW_##TYPE(FIELD)
+#define CAP_INTERNAL_OPTION_DOC(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP) { CH, LONG_NAME, HELP },
+#define CAP_INTERNAL_OPTION_DEFAULT(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP) options->FIELD = DEFAULT;
+
+// Options without a single char flag get a label the unsigned char can't reach
+#define CAP_INTERNAL_OPTION_CASE(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP)\
+    case (CH) ? (unsigned char)(CH) : 256 + __COUNTER__:\
+        return CAP_INTERNAL_OPTION_READ_##TYPE(options->FIELD);
+
+// The length is a constant, so mismatching names are rejected without touching the strings
+#define CAP_INTERNAL_OPTION_MATCH(TYPE, FIELD, CH, LONG_NAME, DEFAULT, HELP)\
+    if(\
+        sizeof(LONG_NAME) > 1\
+        && length == (int)sizeof(LONG_NAME) - 1\
+        && str[0] == (LONG_NAME)[0]\
+        && CAP_STRN_CMP(str, LONG_NAME, sizeof(LONG_NAME) - 1) == 0\
+    ) {\
+        return CAP_INTERNAL_OPTION_READ_##TYPE(options->FIELD);\
+    }
+
+#define CAP_INTERNAL_OPTION_WIDE_FLAG(FIELD)
+#define CAP_INTERNAL_OPTION_WIDE_STRING(FIELD) char* FIELD;
+#define CAP_INTERNAL_OPTION_WIDE_INT(FIELD) long long FIELD;
+#define CAP_INTERNAL_OPTION_WIDE_U64(FIELD) unsigned long long FIELD;
+#define CAP_INTERNAL_OPTION_WIDE_SIZE(FIELD) unsigned long long FIELD;
+#define CAP_INTERNAL_OPTION_WIDE_DURATION(FIELD) unsigned long long FIELD;
+#define CAP_INTERNAL_OPTION_WIDE_DOUBLE(FIELD) double FIELD;
+
+#define CAP_INTERNAL_OPTION_NARROW_FLAG(FIELD) int FIELD;
+#define CAP_INTERNAL_OPTION_NARROW_STRING(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW_INT(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW_U64(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW_SIZE(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW_DURATION(FIELD)
+#define CAP_INTERNAL_OPTION_NARROW_DOUBLE(FIELD)
+
+#define CAP_INTERNAL_OPTION_READ_FLAG(DEST) ((DEST)++, CAP_SPEC_HANDLED)
+#define CAP_INTERNAL_OPTION_READ_STRING(DEST) CapInternalOptionString(Cap_Value(iterator, item), &(DEST))
+#define CAP_INTERNAL_OPTION_READ_INT(DEST) CapInternalOptionStatus(Cap_ValueInt(iterator, item, &(DEST)))
+#define CAP_INTERNAL_OPTION_READ_U64(DEST) CapInternalOptionStatus(Cap_ValueU64(iterator, item, &(DEST)))
+#define CAP_INTERNAL_OPTION_READ_SIZE(DEST) CapInternalOptionStatus(Cap_ValueSize(iterator, item, &(DEST)))
+#define CAP_INTERNAL_OPTION_READ_DURATION(DEST) CapInternalOptionStatus(Cap_ValueDuration(iterator, item, &(DEST)))
+#define CAP_INTERNAL_OPTION_READ_DOUBLE(DEST) CapInternalOptionStatus(Cap_ValueDouble(iterator, item, &(DEST)))
+
 #endif // CAP_H
@@ -1,10 +1,97 @@
+#define _DEFAULT_SOURCE
+
+#include <locale.h>
+
 #include "tests-new.h"
 
 #include "tests.h"
 
+// CAP_TESTS_MINIMAL checks the core without any of the optional features
+#if !defined(CAP_TESTS_MINIMAL)
+    #define CAP_RESPONSE_FILES
+    #define CAP_ARENA
+    #define CAP_CONFIG_FILES
+    #define CAP_PARALLEL_TOKENIZE
+    #define CAP_STATS
+
+    #if defined(__linux__)
+        #define CAP_PROC_SCANNER
+    #endif // __linux__
+#endif // CAP_TESTS_MINIMAL
 #define CAP_IMPLEMENTATION
 #include "../cap.h"
 
+void countTrace(Cap_Iterator* iterator, Cap_Item* item, int isDry, void* context);
+void countTrace(Cap_Iterator* iterator, Cap_Item* item, int isDry, void* context) {
+    (void)iterator;
+
+    if(!isDry && item) (*(int*)context)++;
+}
+
+struct CommandRun {
+    char* name;
+    int argc;
+    char** argv;
+    int flags;
+    char* value;
+};
+
+int runCommand(Cap_Command* command, Cap_Iterator* iterator, void* context);
+int runCommand(Cap_Command* command, Cap_Iterator* iterator, void* context) {
+    struct CommandRun* run = context;
+
+    run->name = command->name;
+    run->argc = iterator->argc;
+    run->argv = iterator->argv;
+
+    Cap_Item item;
+    while(Cap_Next(iterator, &item)) {
+        if(item.type == CAP_ARG) run->value = item.value.arg;
+        else run->flags++;
+    }
+
+    return command->data ? *(int*)command->data : 0;
+}
+
+#define TEST_OPTIONS(X)\
+    X(FLAG, verbose, 'v', "verbose", 0, "Print more")\
+    X(INT, jobs, 'j', "jobs", 1, "Number of jobs")\
+    X(STRING, output, 'o', "output", "a.out", "Output file")\
+    X(SIZE, limit, 0, "limit", 0, "Memory limit")\
+    X(FLAG, quiet, 'q', "", 0, "Print nothing")
+
+CAP_DEFINE_OPTIONS(TestOptions, TEST_OPTIONS)
+
+#if defined(CAP_PROC_SCANNER)
+    struct ProcessSearch {
+        int pid;
+        int found;
+        int argc;
+        int tokens;
+    };
+
+    int findProcess(int pid, int argc, char** argv, Cap_Tokens* tokens, void* context);
+    int findProcess(int pid, int argc, char** argv, Cap_Tokens* tokens, void* context) {
+        (void)argv;
+        struct ProcessSearch* search = context;
+
+        if(pid != search->pid) return 0;
+
+        search->found = 1;
+        search->argc = argc;
+        search->tokens = tokens->length;
+
+        return 1;
+    }
+#endif // CAP_PROC_SCANNER
+
+int rejectEmpty(Cap_Option* option, char* value);
+int rejectEmpty(Cap_Option* option, char* value) {
+    (void)option;
+
+    return value == NULL;
+}
+
 DESCRIBE(main) {
     IT("reads arguments correctly") {
         char* argv[] = { "arg1", "arg2", "-dfc=val", "-p", "arg3", "-b", "arg4", "--flag", "--str=val", "arg5" };
@@ -165,4 +252,1359 @@ DESCRIBE(main) {
         EXPECT(item.value.longFlag.terminated) TO_BE_FALSY;
         EXPECT(item.value.longFlag.attached) TO_BE_STRING("value");
     }
+
+    IT("matches long flags exactly") {
+        char* argv[] = { "--in", "--input=file", "--inputs", "--output" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        char* input = NULL;
+        int unmatched = 0;
+
+        CAP_PARSE_SWITCH(argc, argv) {
+            CAP_LONG_FLAGS(
+                CAP_MATCH_LFLAG("input", {
+                    input = Cap_getFlagValue();
+                })
+                CAP_MATCH_LFLAG("output", {})
+                CAP_UNMATCHED_LFLAGS(name, {
+                    (void)name;
+                    unmatched++;
+                })
+            )
+        }
+
+        EXPECT(input) TO_BE_STRING("file");
+        EXPECT(unmatched) TO_BE(2);
+    }
+
+    IT("parses long flags with long names and values") {
+        char arg[4096];
+        memset(arg, 'x', sizeof(arg) - 1);
+        arg[0] = arg[1] = '-';
+        arg[sizeof(arg) - 1] = '\0';
+
+        Cap_Item item;
+        Cap_Parse(arg, &item);
+        EXPECT(item.type) TO_BE(CAP_LONG_FLAG);
+        EXPECT(item.value.longFlag.length) TO_BE((int)sizeof(arg) - 3);
+        EXPECT(item.value.longFlag.terminated) TO_BE_TRUTHY;
+        EXPECT(item.value.longFlag.attached) TO_BE_NULL;
+
+        arg[1000] = '=';
+        Cap_Parse(arg, &item);
+        EXPECT(item.value.longFlag.length) TO_BE(998);
+        EXPECT(item.value.longFlag.terminated) TO_BE_FALSY;
+        EXPECT(item.value.longFlag.attached) TO_BE(arg + 1001);
+
+        arg[1001] = '\0';
+        Cap_Parse(arg, &item);
+        EXPECT(item.value.longFlag.length) TO_BE(998);
+        EXPECT(item.value.longFlag.terminated) TO_BE_FALSY;
+        EXPECT(item.value.longFlag.attached) TO_BE_NULL;
+    }
+
+    IT("carries lengths and positions") {
+        char* argv[] = { "file.c", "-ab=xyz", "--out=dir/a", "--name", "value" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        Cap_Item item;
+
+        Cap_Next(&iterator, &item);
+        EXPECT(item.length) TO_BE(-1);
+        EXPECT(Cap_Length(&item)) TO_BE(6);
+        EXPECT(item.length) TO_BE(6);
+        EXPECT(item.index) TO_BE(0);
+        EXPECT(item.offset) TO_BE(0);
+
+        Cap_Next(&iterator, &item);
+        EXPECT(item.value.flag.ch) TO_BE('a');
+        EXPECT(item.length) TO_BE(1);
+        EXPECT(item.attachedLength) TO_BE(0);
+        EXPECT(item.index) TO_BE(1);
+        EXPECT(item.offset) TO_BE(1);
+
+        Cap_Next(&iterator, &item);
+        EXPECT(item.value.flag.ch) TO_BE('b');
+        EXPECT(item.attachedLength) TO_BE(-1);
+        EXPECT(item.index) TO_BE(1);
+        EXPECT(item.offset) TO_BE(2);
+
+        int length = 0;
+        EXPECT(Cap_ValueView(&iterator, &item, &length)) TO_BE_STRING("xyz");
+        EXPECT(length) TO_BE(3);
+        EXPECT(item.attachedLength) TO_BE(3);
+
+        Cap_Next(&iterator, &item);
+        EXPECT(item.length) TO_BE(3);
+        EXPECT(Cap_ValueView(&iterator, &item, &length)) TO_BE_STRING("dir/a");
+        EXPECT(length) TO_BE(5);
+        EXPECT(item.index) TO_BE(2);
+        EXPECT(item.offset) TO_BE(2);
+
+        Cap_Next(&iterator, &item);
+        EXPECT(item.index) TO_BE(3);
+
+        EXPECT(Cap_ValueView(&iterator, &item, &length)) TO_BE_STRING("value");
+        EXPECT(length) TO_BE(5);
+
+        Cap_Parse("arg", &item);
+        EXPECT(Cap_Length(&item)) TO_BE(3);
+        EXPECT(item.index) TO_BE(-1);
+    }
+
+    IT("tokenizes arguments") {
+        char* argv[] = { "arg1", "-dfc=val", "-p", "--flag", "--str=val", "-e=" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        signed char types[10];
+        int indexes[10];
+        int offsets[10];
+        int lengths[10];
+        int attached[10];
+
+        Cap_Tokens tokens = {
+            .capacity = 10,
+            .types = types,
+            .indexes = indexes,
+            .offsets = offsets,
+            .lengths = lengths,
+            .attached = attached,
+        };
+
+        EXPECT(Cap_Tokenize(argc, argv, &tokens)) TO_BE(1);
+        EXPECT(tokens.length) TO_BE(8);
+
+        signed char expectedTypes[] = { CAP_ARG, CAP_FLAG, CAP_FLAG, CAP_FLAG, CAP_FLAG, CAP_LONG_FLAG, CAP_LONG_FLAG, CAP_FLAG };
+        int expectedIndexes[] = { 0, 1, 1, 1, 2, 3, 4, 5 };
+        int expectedOffsets[] = { 0, 1, 2, 3, 1, 2, 2, 1 };
+        int expectedLengths[] = { 4, 1, 1, 1, 1, 4, 3, 1 };
+        int expectedAttached[] = { 0, 0, 0, 5, 0, 0, 6, 0 };
+
+        EXPECT(tokens.types) TO_HAVE_BYTES(expectedTypes, sizeof(expectedTypes));
+        EXPECT(tokens.indexes) TO_HAVE_BYTES(expectedIndexes, sizeof(expectedIndexes));
+        EXPECT(tokens.offsets) TO_HAVE_BYTES(expectedOffsets, sizeof(expectedOffsets));
+        EXPECT(tokens.lengths) TO_HAVE_BYTES(expectedLengths, sizeof(expectedLengths));
+        EXPECT(tokens.attached) TO_HAVE_BYTES(expectedAttached, sizeof(expectedAttached));
+
+        Cap_Tokens small = { .capacity = 3, .types = types };
+        EXPECT(Cap_Tokenize(argc, argv, &small)) TO_BE(0);
+        EXPECT(small.length) TO_BE(3);
+
+        // Everything after "--" is a general arg and the terminator itself is not a token
+        char* terminated[] = { "-a", "--", "-rf", "--", "--x=1" };
+
+        EXPECT(Cap_Tokenize(5, terminated, &tokens)) TO_BE(1);
+        EXPECT(tokens.length) TO_BE(4);
+
+        signed char terminatedTypes[] = { CAP_FLAG, CAP_ARG, CAP_ARG, CAP_ARG };
+        int terminatedIndexes[] = { 0, 2, 3, 4 };
+        int terminatedLengths[] = { 1, 3, 2, 5 };
+
+        EXPECT(tokens.types) TO_HAVE_BYTES(terminatedTypes, sizeof(terminatedTypes));
+        EXPECT(tokens.indexes) TO_HAVE_BYTES(terminatedIndexes, sizeof(terminatedIndexes));
+        EXPECT(tokens.lengths) TO_HAVE_BYTES(terminatedLengths, sizeof(terminatedLengths));
+    }
+
+    IT("peeks ahead") {
+        char* argv[] = { "--range", "1", "10", "-ab", "x" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        Cap_Item item;
+        Cap_Item peeked;
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_LONG_FLAG);
+
+        EXPECT(Cap_Peek(&iterator, 1, &peeked)) TO_BE(1);
+        EXPECT(peeked.value.arg) TO_BE_STRING("10");
+        EXPECT(Cap_Peek(&iterator, 3, &peeked)) TO_BE(1);
+        EXPECT(peeked.value.flag.ch) TO_BE('b');
+        EXPECT(Cap_Peek(&iterator, CAP_LOOKAHEAD_SIZE, &peeked)) TO_BE(0);
+        EXPECT(peeked.type) TO_BE(CAP_NONE);
+
+        EXPECT(Cap_Value(&iterator, &item)) TO_BE_STRING("1");
+        EXPECT(Cap_Check(&iterator, &peeked)) TO_BE(1);
+        EXPECT(peeked.value.arg) TO_BE_STRING("10");
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.arg) TO_BE_STRING("10");
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.flag.ch) TO_BE('a');
+        EXPECT(Cap_Peek(&iterator, 1, &peeked)) TO_BE(1);
+        EXPECT(peeked.value.arg) TO_BE_STRING("x");
+        EXPECT(Cap_Peek(&iterator, 2, &peeked)) TO_BE(0);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.flag.ch) TO_BE('b');
+        EXPECT(Cap_Value(&iterator, &item)) TO_BE_STRING("x");
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+    }
+
+    IT("ends options at --") {
+        char* argv[] = { "-v", "--output", "out.o", "--", "-x", "--", "file.c", "--name=y" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        Cap_Item item;
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.flag.ch) TO_BE('v');
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Value(&iterator, &item)) TO_BE_STRING("out.o");
+        EXPECT(iterator.optionsEnded) TO_BE(0);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_ARG);
+        EXPECT(item.value.arg) TO_BE_STRING("-x");
+        EXPECT(Cap_Length(&item)) TO_BE(2);
+        EXPECT(item.index) TO_BE(4);
+        EXPECT(iterator.optionsEnded) TO_BE(1);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_ARG);
+        EXPECT(item.value.arg) TO_BE_STRING("--");
+
+        int restArgc = 0;
+        char** restArgv = NULL;
+
+        // The peeked item is handed out again as a part of the rest
+        EXPECT(Cap_Check(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Rest(&iterator, &restArgc, &restArgv)) TO_BE(1);
+        EXPECT(restArgc) TO_BE(2);
+        EXPECT(restArgv[0]) TO_BE_STRING("file.c");
+        EXPECT(restArgv[1]) TO_BE_STRING("--name=y");
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(0);
+
+        EXPECT(Cap_Rest(&iterator, &restArgc, &restArgv)) TO_BE(1);
+        EXPECT(restArgc) TO_BE(0);
+
+        // A bare -- at the end is not an item
+        char* terminated[] = { "-a", "--" };
+        Cap_Init(2, terminated, &iterator);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+
+        // The rest can't start in the middle of merged flags
+        char* merged[] = { "-ab", "file.c" };
+        Cap_Init(2, merged, &iterator);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Rest(&iterator, &restArgc, &restArgv)) TO_BE(0);
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.flag.ch) TO_BE('b');
+        EXPECT(Cap_Rest(&iterator, &restArgc, &restArgv)) TO_BE(1);
+        EXPECT(restArgc) TO_BE(1);
+        EXPECT(restArgv[0]) TO_BE_STRING("file.c");
+
+        // The options end for the switch macros as well
+        char* switched[] = { "--", "-v" };
+        int verbose = 0;
+        int files = 0;
+
+        CAP_PARSE_SWITCH(2, switched) {
+            CAP_FLAGS(
+                CAP_MATCH_FLAG('v', {
+                    verbose = 1;
+                })
+            )
+            CAP_ARGS(file, {
+                (void)file;
+                files++;
+            })
+        }
+
+        EXPECT(verbose) TO_BE(0);
+        EXPECT(files) TO_BE(1);
+
+        // A flag doesn't take its value across the terminator
+        char* valued[] = { "--color", "--", "file.c" };
+        Cap_Init(3, valued, &iterator);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Value(&iterator, &item)) TO_BE_NULL;
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_ARG);
+        EXPECT(item.value.arg) TO_BE_STRING("file.c");
+
+        // The same when the argument after it was already peeked
+        Cap_Init(3, valued, &iterator);
+
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(Cap_Peek(&iterator, 0, NULL)) TO_BE(1);
+        EXPECT(Cap_Value(&iterator, &item)) TO_BE_NULL;
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(1);
+        EXPECT(item.value.arg) TO_BE_STRING("file.c");
+    }
+
+#if defined(CAP_STATS)
+    IT("collects parsing stats") {
+        char* argv[] = { "-ab", "--output", "file", "--verbose", "arg" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        int traced = 0;
+        Cap_Trace(&iterator, countTrace, &traced);
+
+        Cap_Item item;
+        while(Cap_Next(&iterator, &item)) {
+            if(item.type == CAP_LONG_FLAG) Cap_Value(&iterator, &item);
+        }
+
+        EXPECT(iterator.stats.items) TO_BE(6);
+        EXPECT(iterator.stats.checks) TO_BE(2);
+        EXPECT(iterator.stats.parses) TO_BE(5);
+        EXPECT(iterator.stats.merged) TO_BE(1);
+        EXPECT(traced) TO_BE(6);
+
+        Cap_Stats stats = { 0 };
+
+        CAP_PARSE_SWITCH(argc, argv) {
+            CAP_LONG_FLAGS(
+                CAP_MATCH_LFLAG("output", {})
+                CAP_MATCH_LFLAG("verbose", {})
+            )
+            CAP_ARGS(arg, {
+                (void)arg;
+                stats = CAP_LOCAL_ARGS.stats;
+            })
+        }
+
+        EXPECT(stats.items) TO_BE(6);
+#if defined(CAP_HASHED_LFLAGS)
+        EXPECT(stats.lookups) TO_BE(2);
+#else
+        EXPECT(stats.compares) TO_BE(2);
+#endif // CAP_HASHED_LFLAGS
+    }
+#endif // CAP_STATS
+
+#if defined(CAP_PARALLEL_TOKENIZE)
+    IT("tokenizes arguments in parallel") {
+        static char* samples[] = { "-xvzf", "--output=out.o", "file.c", "-o", "-", "-ab=c", "--=v", "-e=" };
+        static char* argv[20000];
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        for(int i = 0; i < argc; i++) argv[i] = samples[(i * 7 + i / 3) % (sizeof(samples) / sizeof(samples[0]))];
+
+        static signed char types[2][60000];
+        static int indexes[2][60000];
+        static int offsets[2][60000];
+        static int lengths[2][60000];
+        static int attached[2][60000];
+
+        Cap_Tokens sequential = {
+            .capacity = 60000, .types = types[0], .indexes = indexes[0], .offsets = offsets[0], .lengths = lengths[0], .attached = attached[0],
+        };
+        Cap_Tokens parallel = {
+            .capacity = 60000, .types = types[1], .indexes = indexes[1], .offsets = offsets[1], .lengths = lengths[1], .attached = attached[1],
+        };
+
+        EXPECT(Cap_Tokenize(argc, argv, &sequential)) TO_BE(1);
+        EXPECT(Cap_TokenizeParallel(argc, argv, &parallel, 4)) TO_BE(1);
+
+        EXPECT(parallel.length) TO_BE(sequential.length);
+        EXPECT((signed char*)types[1]) TO_HAVE_BYTES(types[0], (size_t)sequential.length);
+        EXPECT((int*)indexes[1]) TO_HAVE_BYTES(indexes[0], sequential.length * sizeof(int));
+        EXPECT((int*)offsets[1]) TO_HAVE_BYTES(offsets[0], sequential.length * sizeof(int));
+        EXPECT((int*)lengths[1]) TO_HAVE_BYTES(lengths[0], sequential.length * sizeof(int));
+        EXPECT((int*)attached[1]) TO_HAVE_BYTES(attached[0], sequential.length * sizeof(int));
+
+        Cap_Tokens small = { .capacity = 100, .types = types[1] };
+        EXPECT(Cap_TokenizeParallel(argc, argv, &small, 4)) TO_BE(0);
+        EXPECT(small.length) TO_BE(100);
+
+        // A "--" in the second range ends the options of the later ones
+        argv[7000] = "--";
+
+        EXPECT(Cap_Tokenize(argc, argv, &sequential)) TO_BE(1);
+        EXPECT(Cap_TokenizeParallel(argc, argv, &parallel, 4)) TO_BE(1);
+
+        EXPECT(parallel.length) TO_BE(sequential.length);
+        EXPECT((signed char*)types[1]) TO_HAVE_BYTES(types[0], (size_t)sequential.length);
+        EXPECT((int*)indexes[1]) TO_HAVE_BYTES(indexes[0], sequential.length * sizeof(int));
+
+        // One token per argument after it
+        int after = argc - 7001;
+        EXPECT(indexes[1][parallel.length - after]) TO_BE(7001);
+        EXPECT(indexes[1][parallel.length - 1]) TO_BE(argc - 1);
+        EXPECT(types[1][parallel.length - after]) TO_BE(CAP_ARG);
+        EXPECT(types[1][parallel.length - 1]) TO_BE(CAP_ARG);
+    }
+#endif // CAP_PARALLEL_TOKENIZE
+
+    IT("validates UTF-8 while tokenizing") {
+        EXPECT(Cap_Utf8Check("h\xC3\xA9llo \xE2\x9C\x93 \xF0\x9F\x98\x80", 15)) TO_BE(-1);
+        EXPECT(Cap_Utf8Check("\xC0\xAF", 2)) TO_BE(0);
+        EXPECT(Cap_Utf8Check("a\xED\xA0\x80", 4)) TO_BE(1);
+        EXPECT(Cap_Utf8Check("ab\xF4\x90\x80\x80", 6)) TO_BE(2);
+        EXPECT(Cap_Utf8Check("abc\xE2\x82", 5)) TO_BE(3);
+        EXPECT(Cap_Utf8Check("\x80", 1)) TO_BE(0);
+
+        // Long strings go through the vector path
+        char text[100];
+        memset(text, 'x', sizeof(text));
+        memcpy(text + 40, "\xE2\x9C\x93", 3);
+        EXPECT(Cap_Utf8Check(text, 100)) TO_BE(-1);
+        memcpy(text + 63, "\xF0\x9F\x98", 3);
+        EXPECT(Cap_Utf8Check(text, 100)) TO_BE(63);
+        EXPECT(Cap_Utf8Check(text, 66)) TO_BE(63);
+
+        char* argv[] = { "--name=Zo\xC3\xAB", "-v", "file\xFF.c", "bad\xC3" };
+        signed char types[8];
+
+        Cap_Utf8Error error;
+        Cap_Tokens tokens = { .capacity = 8, .types = types, .utf8 = &error };
+
+        EXPECT(Cap_Tokenize(4, argv, &tokens)) TO_BE(1);
+        EXPECT(error.index) TO_BE(2);
+        EXPECT(error.offset) TO_BE(4);
+
+        EXPECT(Cap_Tokenize(2, argv, &tokens)) TO_BE(1);
+        EXPECT(error.index) TO_BE(-1);
+
+#if defined(CAP_PARALLEL_TOKENIZE)
+        static char* many[20000];
+        for(int i = 0; i < 20000; i++) many[i] = i == 15000 ? argv[3] : i == 17000 ? argv[2] : argv[0];
+
+        static signed char manyTypes[20000];
+        Cap_Tokens parallel = { .capacity = 20000, .types = manyTypes, .utf8 = &error };
+
+        EXPECT(Cap_TokenizeParallel(20000, many, &parallel, 4)) TO_BE(1);
+        EXPECT(error.index) TO_BE(15000);
+        EXPECT(error.offset) TO_BE(3);
+#endif // CAP_PARALLEL_TOKENIZE
+    }
+
+    IT("scans short flags") {
+        char* argv[] = { "-xvzf", "file.tar", "-vv", "--verbose", "-", "-o=out", "-c" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_FlagSet set;
+
+        EXPECT(Cap_ScanFlags(argc, argv, &set)) TO_BE(8);
+
+        EXPECT(CAP_FLAG_SEEN(&set, 'x')) TO_BE(1);
+        EXPECT(CAP_FLAG_SEEN(&set, 'o')) TO_BE(1);
+        EXPECT(CAP_FLAG_SEEN(&set, 'c')) TO_BE(1);
+        EXPECT(CAP_FLAG_SEEN(&set, 'a')) TO_BE(0);
+        EXPECT(CAP_FLAG_SEEN(&set, '=')) TO_BE(0);
+        EXPECT(CAP_FLAG_SEEN(&set, '\0')) TO_BE(0);
+        EXPECT(CAP_FLAG_COUNT(&set, 'v')) TO_BE(3);
+        EXPECT(CAP_FLAG_COUNT(&set, 'f')) TO_BE(1);
+        EXPECT(CAP_FLAG_COUNT(&set, 'u')) TO_BE(0);
+
+        char* empty[] = { "arg" };
+        EXPECT(Cap_ScanFlags(1, empty, &set)) TO_BE(0);
+        EXPECT(CAP_FLAG_SEEN(&set, 'v')) TO_BE(0);
+        EXPECT(CAP_FLAG_COUNT(&set, 'v')) TO_BE(0);
+
+        char* again[] = { "-v" };
+        EXPECT(Cap_ScanFlags(1, again, &set)) TO_BE(1);
+        EXPECT(CAP_FLAG_COUNT(&set, 'v')) TO_BE(1);
+
+        char* terminated[] = { "-v", "--", "-rf" };
+        EXPECT(Cap_ScanFlags(3, terminated, &set)) TO_BE(1);
+        EXPECT(CAP_FLAG_SEEN(&set, 'r')) TO_BE(0);
+        EXPECT(CAP_FLAG_SEEN(&set, 'f')) TO_BE(0);
+    }
+
+    IT("indexes flags") {
+        char* argv[] = { "-vo", "out1", "--include=a", "arg", "--include", "b", "-o=out2", "--include", "--dry-run", "-v" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_IndexKey keys[8];
+        Cap_IndexValue values[16];
+        Cap_Index index;
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        EXPECT(Cap_IndexInit(&index, &iterator, keys, 8, values, 16)) TO_BE(1);
+
+        EXPECT(Cap_IndexCount(&index, "-v")) TO_BE(2);
+        EXPECT(Cap_IndexCount(&index, "-o")) TO_BE(2);
+        EXPECT(Cap_IndexCount(&index, "--include")) TO_BE(3);
+        EXPECT(Cap_IndexCount(&index, "--dry-run")) TO_BE(1);
+        EXPECT(Cap_IndexCount(&index, "--dry")) TO_BE(0);
+        EXPECT(Cap_IndexCount(&index, "-x")) TO_BE(0);
+        EXPECT(Cap_IndexCount(&index, "arg")) TO_BE(0);
+
+        EXPECT(Cap_IndexLast(&index, "-o")) TO_BE_STRING("out2");
+        EXPECT(Cap_IndexLast(&index, "-v")) TO_BE_NULL;
+        EXPECT(Cap_IndexLast(&index, "--missing")) TO_BE_NULL;
+
+        char* includes[4];
+        EXPECT(Cap_IndexValues(&index, "--include", includes, 4)) TO_BE(2);
+        EXPECT(includes[0]) TO_BE_STRING("a");
+        EXPECT(includes[1]) TO_BE_STRING("b");
+
+        EXPECT(Cap_IndexValues(&index, "-o", includes, 1)) TO_BE(2);
+        EXPECT(includes[0]) TO_BE_STRING("out1");
+
+        Cap_Init(argc, argv, &iterator);
+        EXPECT(Cap_IndexInit(&index, &iterator, keys, 2, values, 16)) TO_BE(0);
+
+        Cap_Init(argc, argv, &iterator);
+        EXPECT(Cap_IndexInit(&index, &iterator, keys, 8, values, 4)) TO_BE(0);
+
+        // The flag ends at "--", so the argument after it is not its value
+        char* terminated[] = { "--foo", "--", "bar" };
+        Cap_Init(3, terminated, &iterator);
+
+        EXPECT(Cap_IndexInit(&index, &iterator, keys, 8, values, 16)) TO_BE(1);
+        EXPECT(Cap_IndexCount(&index, "--foo")) TO_BE(1);
+        EXPECT(Cap_IndexLast(&index, "--foo")) TO_BE_NULL;
+    }
+
+#if defined(CAP_RESPONSE_FILES)
+    IT("expands response files") {
+        char* argv[] = { "-a", "@tests/fixtures/response.txt", "@tests/fixtures/missing.txt", "last" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        Cap_Iterator args;
+        Cap_Init(argc, argv, &args);
+
+        Cap_Item arg;
+
+        Cap_Next(&args, &arg);
+        EXPECT(arg.value.flag.ch) TO_BE('a');
+
+        Cap_Next(&args, &arg);
+        EXPECT(arg.type) TO_BE(CAP_LONG_FLAG);
+        EXPECT(arg.value.longFlag.attached) TO_BE_STRING("John Smith");
+        int length = 0;
+        EXPECT(Cap_ValueView(&args, &arg, &length)) TO_BE_STRING("John Smith");
+        EXPECT(length) TO_BE(10);
+        EXPECT(arg.index) TO_BE(1);
+        EXPECT(arg.offset) TO_BE(2);
+
+        Cap_Next(&args, &arg);
+        EXPECT(arg.type) TO_BE(CAP_FLAG);
+        EXPECT(arg.value.flag.ch) TO_BE('o');
+        EXPECT(arg.index) TO_BE(1);
+        EXPECT(arg.offset) TO_BE(21);
+
+        length = 0;
+        EXPECT(Cap_ValueView(&args, &arg, &length)) TO_BE_STRING("single 'quoted' \"value\"");
+        EXPECT(length) TO_BE(23);
+
+        char* expected[] = {
+            "nested",
+            "@tests/fixtures/nested.txt",
+            "escaped space",
+            "after",
+            "@tests/fixtures/missing.txt",
+            "last",
+        };
+
+        for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+            Cap_Next(&args, &arg);
+            EXPECT(arg.type) TO_BE(CAP_ARG);
+            EXPECT(arg.value.arg) TO_BE_STRING(expected[i]);
+        }
+
+        EXPECT(Cap_Next(&args, &arg)) TO_BE(0);
+
+        Cap_Release(&args);
+
+        // After "--" the files are not expanded, so Cap_Next() and Cap_Rest() see the same arguments
+        char* terminated[] = { "--", "@tests/fixtures/nested.txt" };
+        Cap_Init(2, terminated, &args);
+
+        EXPECT(Cap_Next(&args, &arg)) TO_BE(1);
+        EXPECT(arg.type) TO_BE(CAP_ARG);
+        EXPECT(arg.value.arg) TO_BE_STRING("@tests/fixtures/nested.txt");
+        EXPECT(Cap_Next(&args, &arg)) TO_BE(0);
+
+        Cap_Release(&args);
+
+        // The slot of a file read to the end is reused, so the limit is on nesting and not on the total
+        char* many[CAP_RESPONSE_FILES_MAX + 4];
+        int manyCount = sizeof(many) / sizeof(many[0]);
+        for(int i = 0; i < manyCount; i++) many[i] = "@tests/fixtures/nested.txt";
+
+        Cap_Init(manyCount, many, &args);
+
+        int expanded = 0;
+        while(Cap_Next(&args, &arg)) expanded += strcmp(arg.value.arg, "nested") == 0;
+
+        EXPECT(expanded) TO_BE(manyCount);
+        EXPECT(args.filesCount) TO_BE(0);
+
+        Cap_Release(&args);
+        EXPECT(args.mappings) TO_BE_NULL;
+    }
+#endif // CAP_RESPONSE_FILES
+
+#if defined(CAP_ARENA)
+    IT("carves results from the arena") {
+        char buffer[64];
+
+        Cap_Arena arena;
+        Cap_ArenaInit(&arena, buffer, sizeof(buffer));
+
+        char* first = Cap_ArenaAlloc(&arena, 3);
+        long long* second = CAP_ARENA_ARRAY(&arena, long long, 2);
+
+        EXPECT(first == buffer + ((CAP_ARENA_ALIGN - (size_t)buffer % CAP_ARENA_ALIGN) % CAP_ARENA_ALIGN)) TO_BE_TRUTHY;
+        EXPECT((size_t)second % CAP_ARENA_ALIGN) TO_BE(0);
+        EXPECT(arena.chunks == NULL) TO_BE_TRUTHY;
+
+        // The buffer can't fit it, so the rest comes from mapped chunks
+        EXPECT(Cap_ArenaAlloc(&arena, sizeof(buffer)) != NULL) TO_BE_TRUTHY;
+        char* name = Cap_ArenaString(&arena, "--output=build/out.o", 8);
+        EXPECT(name) TO_BE_STRING("--output");
+        EXPECT(arena.chunks != NULL) TO_BE_TRUTHY;
+
+        char* big = Cap_ArenaAlloc(&arena, CAP_ARENA_CHUNK_SIZE);
+        memset(big, 'x', CAP_ARENA_CHUNK_SIZE);
+        EXPECT(Cap_ArenaString(&arena, "next", -1)) TO_BE_STRING("next");
+
+        int argc = 0;
+        char** argv = Cap_ArenaSplit(&arena, "  run -v --name=\"John Smith\" 'a b'c ", &argc);
+        EXPECT(argc) TO_BE(4);
+        EXPECT(argv[2]) TO_BE_STRING("--name=John Smith");
+        EXPECT(argv[3]) TO_BE_STRING("a bc");
+        EXPECT(argv[4]) TO_BE_NULL;
+
+        EXPECT(Cap_ArenaSplit(&arena, " ", &argc)[0]) TO_BE_NULL;
+        EXPECT(argc) TO_BE(0);
+
+        char line[100];
+        for(int i = 0; i < 50; i++) memcpy(line + i * 2, i == 49 ? "z" : "a ", 2);
+
+        argv = Cap_ArenaSplit(&arena, line, &argc);
+        EXPECT(argc) TO_BE(50);
+        EXPECT(argv[48]) TO_BE_STRING("a");
+        EXPECT(argv[49]) TO_BE_STRING("z");
+
+#if defined(CAP_RESPONSE_FILES)
+        // Response files are read into the arena instead of being mapped
+        char* files[] = { "@tests/fixtures/response.txt" };
+
+        Cap_Iterator iterator;
+        Cap_Init(1, files, &iterator);
+        Cap_UseArena(&iterator, &arena);
+
+        Cap_Item item;
+        Cap_Next(&iterator, &item);
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("John Smith");
+        EXPECT(iterator.files[0].size) TO_BE(0);
+
+        while(Cap_Next(&iterator, &item)) {}
+        EXPECT(item.type) TO_BE(CAP_NONE);
+        // Both files were read to the end and nothing is left to unmap
+        EXPECT(iterator.filesCount) TO_BE(0);
+        EXPECT(iterator.mappings) TO_BE_NULL;
+
+        Cap_Release(&iterator);
+#endif // CAP_RESPONSE_FILES
+        Cap_ArenaRelease(&arena);
+
+        EXPECT(arena.chunks == NULL) TO_BE_TRUTHY;
+        EXPECT(arena.buffer == buffer) TO_BE_TRUTHY;
+        EXPECT(arena.used) TO_BE(0);
+    }
+#endif // CAP_ARENA
+
+    IT("splits command lines") {
+        char line[] = "  run -v --name=\"John \\\"J\\\" Smith\" 'it''s' a\\ b \"\" end\\";
+        char* argv[8];
+
+        int argc = Cap_Split(line, argv, 8);
+        EXPECT(argc) TO_BE(7);
+        EXPECT(argv[0]) TO_BE_STRING("run");
+        EXPECT(argv[1]) TO_BE_STRING("-v");
+        EXPECT(argv[2]) TO_BE_STRING("--name=John \"J\" Smith");
+        EXPECT(argv[3]) TO_BE_STRING("its");
+        EXPECT(argv[4]) TO_BE_STRING("a b");
+        EXPECT(argv[5]) TO_BE_STRING("");
+        EXPECT(argv[6]) TO_BE_STRING("end");
+
+        char small[] = "a b c";
+        EXPECT(Cap_Split(small, argv, 2)) TO_BE(-1);
+
+        char empty[] = " \t\n";
+        EXPECT(Cap_Split(empty, argv, 8)) TO_BE(0);
+
+        char posix[] = "cp \\\n  -r\\\nf \"\\$HOME \\` \\a \\\nb\" \\\n";
+        EXPECT(Cap_Split(posix, argv, 8)) TO_BE(3);
+        EXPECT(argv[0]) TO_BE_STRING("cp");
+        EXPECT(argv[1]) TO_BE_STRING("-rf");
+        EXPECT(argv[2]) TO_BE_STRING("$HOME ` \\a b");
+    }
+
+    IT("parses streamed arguments") {
+        Cap_Stream stream;
+        Cap_StreamInit(&stream);
+
+        Cap_Item item;
+
+        char chunk1[] = { 'a', 'r', 'g', '\0', '-', 'a', 'b' };
+        EXPECT(Cap_Feed(&stream, chunk1, sizeof(chunk1))) TO_BE(1);
+
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_ARG);
+        EXPECT(item.value.arg) TO_BE_STRING("arg");
+
+        // The rest of the chunk is not read yet
+        char chunk2[] = { '=', '1', '\0', '-', '-', 'f', 'l' };
+        EXPECT(Cap_Feed(&stream, chunk2, sizeof(chunk2))) TO_BE(0);
+
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+
+        EXPECT(Cap_Feed(&stream, chunk2, sizeof(chunk2))) TO_BE(1);
+
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_FLAG);
+        EXPECT(item.value.flag.ch) TO_BE('a');
+        EXPECT(item.value.flag.attached) TO_BE_NULL;
+
+        // Merged flags are still pending
+        EXPECT(Cap_Feed(&stream, chunk2, sizeof(chunk2))) TO_BE(0);
+
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(1);
+        EXPECT(item.value.flag.ch) TO_BE('b');
+        EXPECT(item.value.flag.attached) TO_BE_STRING("1");
+        EXPECT(item.attachedLength) TO_BE(-1);
+        EXPECT(item.index) TO_BE(1);
+        EXPECT(item.offset) TO_BE(2);
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+
+        char chunk3[] = { 'a', 'g', '=' };
+        Cap_Feed(&stream, chunk3, sizeof(chunk3));
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(0);
+
+        char chunk4[] = { 'v', 'a', 'l', '\0' };
+        Cap_Feed(&stream, chunk4, sizeof(chunk4));
+
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_LONG_FLAG);
+        EXPECT(item.value.longFlag.length) TO_BE(4);
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("val");
+        EXPECT(item.attachedLength) TO_BE(-1);
+        EXPECT(item.index) TO_BE(2);
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(0);
+
+        char big[CAP_STREAM_BUFFER_SIZE];
+        memset(big, 'x', sizeof(big));
+        Cap_Feed(&stream, big, sizeof(big));
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(0);
+
+        char chunk5[] = { 'x', '\0', 'n', 'e', 'x', 't', '\0' };
+        Cap_Feed(&stream, chunk5, sizeof(chunk5));
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(-1);
+        EXPECT(Cap_StreamNext(&stream, &item)) TO_BE(1);
+        EXPECT(item.value.arg) TO_BE_STRING("next");
+    }
+
+#if defined(CAP_CONFIG_FILES)
+    IT("reads options from config files") {
+        Cap_Config config;
+        EXPECT(Cap_ConfigOpen(&config, "tests/fixtures/missing.ini")) TO_BE(0);
+        EXPECT(Cap_ConfigOpen(&config, "tests/fixtures/config.ini")) TO_BE(1);
+
+        Cap_Item item;
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_LONG_FLAG);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("threads");
+        EXPECT(item.length) TO_BE(7);
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("8");
+        EXPECT(item.index) TO_BE(-1);
+        EXPECT(item.offset) TO_BE(18);
+        EXPECT(config.line) TO_BE(2);
+        EXPECT(config.section) TO_BE_NULL;
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("  John Smith  ");
+        EXPECT(item.attachedLength) TO_BE(14);
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("level");
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("debug");
+        EXPECT(config.section) TO_BE_STRING("log");
+        EXPECT(config.line) TO_BE(6);
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("verbose");
+        EXPECT(item.value.longFlag.attached) TO_BE_NULL;
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("path");
+        EXPECT(item.value.longFlag.attached) TO_BE_NULL;
+
+        EXPECT(Cap_ConfigNext(&config, &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+
+        Cap_ConfigRelease(&config);
+
+        // The command line comes after the config, so it overrides it
+        char text[] = "threads=4\r\nverbose\r\n";
+        Cap_ConfigInit(&config, text);
+
+        char* argv[] = { "--threads=16", "input.txt" };
+        char* threads = NULL;
+        char* input = NULL;
+        int verbose = 0;
+        int count = 0;
+
+        CAP_PARSE_CONFIG_SWITCH(&config, 2, argv) {
+            CAP_LONG_FLAGS(
+                CAP_MATCH_LFLAG("threads", {
+                    threads = Cap_getFlagValue();
+                    count++;
+                })
+                CAP_MATCH_LFLAG("verbose", {
+                    verbose = Cap_getFlagValue() == NULL;
+                })
+            )
+            CAP_ARGS(value, {
+                input = value;
+            })
+        }
+
+        EXPECT(count) TO_BE(2);
+        EXPECT(threads) TO_BE_STRING("16");
+        EXPECT(verbose) TO_BE(1);
+        EXPECT(input) TO_BE_STRING("input.txt");
+
+        // Peeking goes on from the last entry to the arguments
+        char small[] = "[server]\nport = 80";
+        Cap_ConfigInit(&config, small);
+
+        Cap_Iterator args;
+        Cap_Init(2, argv, &args);
+        Cap_UseConfig(&args, &config);
+
+        EXPECT(Cap_Peek(&args, 1, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("16");
+        EXPECT(item.index) TO_BE(0);
+
+        Cap_Next(&args, &item);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("port");
+        EXPECT(item.value.longFlag.attached) TO_BE_STRING("80");
+        EXPECT(config.section) TO_BE_STRING("server");
+
+        int restc = 0;
+        char** restv = NULL;
+        EXPECT(Cap_Rest(&args, &restc, &restv)) TO_BE(1);
+        EXPECT(restc) TO_BE(2);
+        EXPECT(restv[0]) TO_BE_STRING("--threads=16");
+    }
+#endif // CAP_CONFIG_FILES
+
+    IT("reads options from the environment") {
+        char* envp[] = {
+            "PATH=/usr/bin",
+            "APP_POOL_SIZE=64",
+            "APP_LOG=",
+            "APP_POOL_SIZE=128",
+            "APP_VERBOSE=1",
+            NULL,
+        };
+
+        Cap_EnvEntry entries[8];
+        Cap_Env env;
+
+        EXPECT(Cap_EnvInit(&env, "APP_", envp, entries, 8)) TO_BE(1);
+        EXPECT(env.count) TO_BE(3);
+
+        EXPECT(Cap_EnvValue(&env, "pool-size")) TO_BE_STRING("64");
+        EXPECT(Cap_EnvValue(&env, "verbose")) TO_BE_STRING("1");
+        EXPECT(Cap_EnvValue(&env, "log")) TO_BE_STRING("");
+        EXPECT(Cap_EnvValue(&env, "path")) TO_BE_NULL;
+        EXPECT(Cap_EnvValue(&env, "pool")) TO_BE_NULL;
+
+        Cap_Item item;
+        EXPECT(Cap_EnvItem(&env, "pool-size", &item)) TO_BE(1);
+        EXPECT(item.type) TO_BE(CAP_LONG_FLAG);
+        EXPECT(item.value.longFlag.length) TO_BE(9);
+        EXPECT(Cap_Value(NULL, &item)) TO_BE_STRING("64");
+
+        EXPECT(Cap_EnvItem(&env, "missing", &item)) TO_BE(0);
+        EXPECT(item.type) TO_BE(CAP_NONE);
+
+        Cap_EnvEntry small[2];
+        EXPECT(Cap_EnvInit(&env, "APP_", envp, small, 2)) TO_BE(0);
+    }
+
+    IT("dispatches options from the spec") {
+        char* output = NULL;
+        int verbose = 0;
+
+        Cap_Option options[] = {
+            { .name = "output", .ch = 'o', .hasValue = 1, .destination = &output },
+            { .name = "verbose", .ch = 'v', .destination = &verbose },
+            { .name = "level", .handler = rejectEmpty },
+        };
+
+        Cap_Option* slots[8];
+        Cap_Spec spec;
+        Cap_SpecInit(&spec, slots, 8);
+
+        for(size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+            EXPECT(Cap_SpecAdd(&spec, options + i)) TO_BE(1);
+        }
+
+        Cap_Option duplicate = { .name = "output" };
+        EXPECT(Cap_SpecAdd(&spec, &duplicate)) TO_BE(0);
+
+        char* argv[] = { "-vv", "--verb", "--verbose", "-o", "file", "--level", "--level=1", "arg", "--output" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+
+        int expected[] = {
+            CAP_SPEC_HANDLED, CAP_SPEC_HANDLED, CAP_SPEC_UNKNOWN, CAP_SPEC_HANDLED, CAP_SPEC_HANDLED,
+            CAP_SPEC_REJECTED, CAP_SPEC_HANDLED, CAP_SPEC_UNKNOWN, CAP_SPEC_NO_VALUE,
+        };
+        int results[sizeof(expected) / sizeof(expected[0])];
+        int count = 0;
+
+        CAP_FOR_EACH(argc, argv, args, arg) {
+            results[count++] = Cap_SpecDispatch(&spec, &args, &arg);
+        }
+
+        EXPECT(count) TO_BE((int)(sizeof(expected) / sizeof(expected[0])));
+        EXPECT((int*)results) TO_HAVE_BYTES(expected, sizeof(expected));
+        EXPECT(verbose) TO_BE(3);
+        EXPECT(output) TO_BE_STRING("file");
+
+        // An empty variable has no value and doesn't take one from the iterator or the arguments
+        char* envp[] = { "APP_OUTPUT=", NULL };
+        Cap_EnvEntry entries[2];
+        Cap_Env env;
+        Cap_EnvInit(&env, "APP_", envp, entries, 2);
+
+        Cap_Item envItem;
+        EXPECT(Cap_EnvItem(&env, "output", &envItem)) TO_BE(1);
+        EXPECT(Cap_SpecDispatch(&spec, NULL, &envItem)) TO_BE(CAP_SPEC_NO_VALUE);
+
+        char* positional[] = { "positional" };
+        Cap_Iterator iterator;
+        Cap_Init(1, positional, &iterator);
+
+        EXPECT(Cap_SpecDispatch(&spec, &iterator, &envItem)) TO_BE(CAP_SPEC_NO_VALUE);
+        EXPECT(output) TO_BE_STRING("file");
+        EXPECT(iterator.index) TO_BE(0);
+    }
+
+#if defined(CAP_CONFIG_FILES)
+    IT("merges options from several sources") {
+        char* output = NULL;
+        char* threads = NULL;
+        char* level = NULL;
+        int verbose = 0;
+
+        Cap_Option options[] = {
+            { .name = "output", .ch = 'o', .hasValue = 1, .destination = &output },
+            { .name = "threads", .hasValue = 1, .destination = &threads },
+            { .name = "verbose", .ch = 'v', .destination = &verbose },
+            { .name = "level", .hasValue = 1, .destination = &level },
+        };
+
+        Cap_Option* slots[16];
+        Cap_Spec spec;
+        Cap_SpecInit(&spec, slots, 16);
+
+        for(int i = 0; i < 4; i++) Cap_SpecAdd(&spec, options + i);
+
+        EXPECT(spec.ids) TO_BE(4);
+        EXPECT(options[3].id) TO_BE(3);
+
+        char* argv[] = { "-vv", "--output", "out.txt", "input.c" };
+        Cap_Iterator args;
+        Cap_Init(4, argv, &args);
+
+        char* envp[] = { "APP_THREADS=8", "APP_OUTPUT=env.txt", "APP_LEVEL=", NULL };
+        Cap_EnvEntry entries[8];
+        Cap_Env env;
+        Cap_EnvInit(&env, "APP_", envp, entries, 8);
+
+        char text[] = "threads = 4\nlevel = debug\nverbose\noutput = conf.txt\n";
+        Cap_Config config;
+        Cap_ConfigInit(&config, text);
+
+        Cap_Iterator defaults;
+        Cap_Init(0, NULL, &defaults);
+        Cap_UseConfig(&defaults, &config);
+
+        char* lowArgv[] = { "--output", "low.txt", "extra" };
+        Cap_Iterator low;
+        Cap_Init(3, lowArgv, &low);
+
+        unsigned long long bitmaps[CAP_MERGE_WORDS(4)];
+        Cap_Merge merge;
+        EXPECT(Cap_MergeInit(&merge, &spec, bitmaps, 1)) TO_BE(0);
+        EXPECT(Cap_MergeInit(&merge, &spec, bitmaps, CAP_MERGE_WORDS(4))) TO_BE(1);
+
+        Cap_MergeIterator(&merge, &low, 0);
+        Cap_MergeIterator(&merge, &defaults, 1);
+        Cap_MergeIterator(&merge, &args, 3);
+        Cap_MergeEnv(&merge, &env, 2);
+
+        Cap_Item item;
+        char* general[2];
+        int generalCount = 0;
+        int dispatched = 0;
+        int noValue = 0;
+
+        while(Cap_MergeNext(&merge, &item)) {
+            if(item.type == CAP_ARG) {
+                general[generalCount++] = item.value.arg;
+                continue;
+            }
+
+            int status = Cap_MergeDispatch(&merge, &item);
+
+            if(status == CAP_SPEC_HANDLED) dispatched++;
+            if(status == CAP_SPEC_NO_VALUE) noValue++;
+        }
+
+        EXPECT(output) TO_BE_STRING("out.txt");
+        EXPECT(verbose) TO_BE(2);
+        EXPECT(threads) TO_BE_STRING("8");
+        EXPECT(level) TO_BE_NULL;
+        EXPECT(dispatched) TO_BE(4);
+        EXPECT(noValue) TO_BE(1);
+
+        EXPECT(generalCount) TO_BE(2);
+        EXPECT(general[0]) TO_BE_STRING("input.c");
+        EXPECT(general[1]) TO_BE_STRING("extra");
+
+        EXPECT(merge.source == NULL) TO_BE_TRUTHY;
+        EXPECT(Cap_MergeNext(&merge, &item)) TO_BE(0);
+
+        // An option added after the init has no bit, so the merge passes it through as unknown
+        static Cap_Option manyOptions[65];
+        static char manyNames[65][8];
+        Cap_Option* manySlots[128];
+        Cap_Spec many;
+        Cap_SpecInit(&many, manySlots, 128);
+
+        for(int i = 0; i < 64; i++) {
+            snprintf(manyNames[i], sizeof(manyNames[i]), "opt%d", i);
+            manyOptions[i].name = manyNames[i];
+            Cap_SpecAdd(&many, manyOptions + i);
+        }
+
+        unsigned long long manyBitmaps[CAP_MERGE_WORDS(64)];
+        EXPECT(Cap_MergeInit(&merge, &many, manyBitmaps, CAP_MERGE_WORDS(64))) TO_BE(1);
+
+        manyOptions[64].name = "late";
+        Cap_SpecAdd(&many, manyOptions + 64);
+        EXPECT(manyOptions[64].id) TO_BE(64);
+
+        char* lateArgv[] = { "--late" };
+        Cap_Init(1, lateArgv, &args);
+        char* lateEnvp[] = { "APP_LATE=1", NULL };
+        Cap_EnvInit(&env, "APP_", lateEnvp, entries, 8);
+
+        Cap_MergeIterator(&merge, &args, 1);
+        Cap_MergeEnv(&merge, &env, 0);
+
+        EXPECT(Cap_MergeNext(&merge, &item)) TO_BE(1);
+        EXPECT(item.value.longFlag.str) TO_BE_STRING("late");
+        EXPECT(merge.option == NULL) TO_BE_TRUTHY;
+        EXPECT(Cap_MergeNext(&merge, &item)) TO_BE(0);
+    }
+#endif // CAP_CONFIG_FILES
+
+    IT("dispatches subcommands") {
+        char* argv[] = { "-v", "get", "-ab", "--all", "key" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+        int getStatus = 7;
+
+        Cap_Command commands[] = {
+            { .name = "status", .handler = runCommand },
+            { .name = "get", .handler = runCommand, .data = &getStatus },
+            { .name = "set", .handler = runCommand },
+        };
+
+        Cap_Command* slots[8];
+        Cap_Commands table;
+        Cap_CommandsInit(&table, slots, 8);
+
+        for(int i = 0; i < 3; i++) {
+            EXPECT(Cap_CommandsAdd(&table, commands + i)) TO_BE(1);
+        }
+        EXPECT(Cap_CommandsAdd(&table, commands)) TO_BE(0);
+
+        EXPECT(Cap_CommandsFind(&table, "settings", 3) == commands + 2) TO_BE_TRUTHY;
+        EXPECT(Cap_CommandsFind(&table, "stat", 4)) TO_BE_NULL;
+
+        struct CommandRun run = { 0 };
+        int result = 0;
+        int dispatched = 0;
+
+        Cap_Iterator iterator;
+        Cap_Init(argc, argv, &iterator);
+
+        Cap_Item item;
+        while(Cap_Next(&iterator, &item)) {
+            if(Cap_CommandsDispatch(&table, &iterator, &item, &run, &result)) dispatched++;
+        }
+
+        EXPECT(dispatched) TO_BE(1);
+        EXPECT(result) TO_BE(7);
+        EXPECT(run.name) TO_BE_STRING("get");
+        EXPECT(run.argc) TO_BE(3);
+        EXPECT(run.argv == argv + 2) TO_BE_TRUTHY;
+        EXPECT(run.flags) TO_BE(3);
+        EXPECT(run.value) TO_BE_STRING("key");
+
+        // A peeked argument is still given to the command
+        struct CommandRun peeked = { 0 };
+        Cap_Init(argc - 1, argv + 1, &iterator);
+        Cap_Next(&iterator, &item);
+        Cap_Peek(&iterator, 0, NULL);
+
+        EXPECT(Cap_CommandsDispatch(&table, &iterator, &item, &peeked, NULL)) TO_BE(1);
+        EXPECT(peeked.flags) TO_BE(3);
+        EXPECT(peeked.value) TO_BE_STRING("key");
+        EXPECT(Cap_Next(&iterator, &item)) TO_BE(0);
+
+        Cap_Init(argc, argv, &iterator);
+        Cap_Next(&iterator, &item);
+        EXPECT(Cap_CommandsDispatch(&table, &iterator, &item, &run, NULL)) TO_BE(0);
+
+        // Names after "--" are general args
+        char* terminated[] = { "--", "get", "set" };
+        Cap_Init(3, terminated, &iterator);
+
+        dispatched = 0;
+        while(Cap_Next(&iterator, &item)) {
+            if(Cap_CommandsDispatch(&table, &iterator, &item, &run, NULL)) dispatched++;
+        }
+
+        EXPECT(dispatched) TO_BE(0);
+
+#if defined(CAP_STATS)
+        // The items read by the command count for the parent too
+        Cap_Init(argc, argv, &iterator);
+        while(Cap_Next(&iterator, &item)) Cap_CommandsDispatch(&table, &iterator, &item, &run, NULL);
+
+        EXPECT(iterator.stats.items) TO_BE(6);
+#endif // CAP_STATS
+    }
+
+    IT("matches unique prefixes of long flags") {
+        char* names[] = { "verbose", "version", "verb", "output", "out-dir", "jobs" };
+        int namesCount = sizeof(names) / sizeof(names[0]);
+
+        Cap_TrieNode nodes[64];
+        Cap_Trie trie;
+        Cap_TrieInit(&trie, nodes, 64);
+
+        for(int i = 0; i < namesCount; i++) {
+            EXPECT(Cap_TrieAdd(&trie, names[i], i)) TO_BE(1);
+        }
+
+        EXPECT(Cap_TrieAdd(&trie, "jobs", 10)) TO_BE(0);
+        EXPECT(Cap_TrieAdd(&trie, "", 10)) TO_BE(0);
+
+        Cap_TrieMatch match;
+
+        EXPECT(Cap_TrieFind(&trie, "verbose", 7, &match)) TO_BE(CAP_TRIE_EXACT);
+        EXPECT(match.id) TO_BE(0);
+
+        EXPECT(Cap_TrieFind(&trie, "verb", 4, &match)) TO_BE(CAP_TRIE_EXACT);
+        EXPECT(match.id) TO_BE(2);
+        EXPECT(match.count) TO_BE(2);
+
+        EXPECT(Cap_TrieFind(&trie, "verbo", 5, &match)) TO_BE(CAP_TRIE_PREFIX);
+        EXPECT(match.id) TO_BE(0);
+
+        EXPECT(Cap_TrieFind(&trie, "j=4", 1, &match)) TO_BE(CAP_TRIE_PREFIX);
+        EXPECT(match.id) TO_BE(5);
+
+        EXPECT(Cap_TrieFind(&trie, "ver", 3, &match)) TO_BE(CAP_TRIE_AMBIGUOUS);
+        EXPECT(match.id) TO_BE(-1);
+        EXPECT(match.count) TO_BE(3);
+
+        int ids[8];
+        int expected[] = { 2, 0, 1 };
+        EXPECT(Cap_TrieCandidates(&trie, &match, ids, 8)) TO_BE(3);
+        EXPECT((int*)ids) TO_HAVE_BYTES(expected, sizeof(expected));
+        EXPECT(Cap_TrieCandidates(&trie, &match, ids, 2)) TO_BE(2);
+
+        EXPECT(Cap_TrieFind(&trie, "outputs", 7, &match)) TO_BE(CAP_TRIE_NONE);
+        EXPECT(Cap_TrieFind(&trie, "x", 1, &match)) TO_BE(CAP_TRIE_NONE);
+        EXPECT(Cap_TrieFind(&trie, "", 0, &match)) TO_BE(CAP_TRIE_NONE);
+        EXPECT(Cap_TrieCandidates(&trie, &match, ids, 8)) TO_BE(0);
+
+        Cap_TrieNode small[4];
+        Cap_TrieInit(&trie, small, 4);
+        EXPECT(Cap_TrieAdd(&trie, "abcd", 0)) TO_BE(0);
+        EXPECT(Cap_TrieAdd(&trie, "abc", 0)) TO_BE(1);
+        EXPECT(Cap_TrieFind(&trie, "a", 1, &match)) TO_BE(CAP_TRIE_PREFIX);
+    }
+
+    IT("generates options from the X-macro list") {
+        char* argv[] = { "-vv", "--jobs=4", "file", "-o", "out", "--limit", "2k", "--quiet", "-q", "--job", "-j", "x", "--limit" };
+        int argc = sizeof(argv) / sizeof(argv[0]);
+        int expected[] = {
+            CAP_SPEC_HANDLED, CAP_SPEC_HANDLED, CAP_SPEC_HANDLED, CAP_SPEC_UNKNOWN, CAP_SPEC_HANDLED, CAP_SPEC_HANDLED,
+            CAP_SPEC_UNKNOWN, CAP_SPEC_HANDLED, CAP_SPEC_UNKNOWN, CAP_SPEC_REJECTED, CAP_SPEC_NO_VALUE
+        };
+        int results[16];
+        int count = 0;
+
+        TestOptions options;
+        TestOptions_Init(&options);
+
+        EXPECT(options.jobs) TO_BE(1);
+        EXPECT(options.output) TO_BE_STRING("a.out");
+
+        CAP_FOR_EACH(argc, argv, args, arg) {
+            results[count++] = TestOptions_Dispatch(&options, &args, &arg);
+        }
+
+        EXPECT(count) TO_BE((int)(sizeof(expected) / sizeof(expected[0])));
+        EXPECT((int*)results) TO_HAVE_BYTES(expected, sizeof(expected));
+        EXPECT(options.verbose) TO_BE(2);
+        EXPECT(options.jobs) TO_BE(4);
+        EXPECT(options.output) TO_BE_STRING("out");
+        EXPECT(options.limit) TO_BE(2048);
+        EXPECT(options.quiet) TO_BE(1);
+
+        EXPECT(TestOptions_Docs[3].name) TO_BE_STRING("limit");
+        EXPECT(TestOptions_Docs[4].ch) TO_BE('q');
+        EXPECT(TestOptions_Docs[5].help) TO_BE_NULL;
+    }
+
+    IT("converts values") {
+        long long integer;
+        EXPECT(Cap_ToInt("1024", &integer)) TO_BE(CAP_VALUE_OK);
+        EXPECT(integer) TO_BE(1024);
+        EXPECT(Cap_ToInt("-9223372036854775808", &integer)) TO_BE(CAP_VALUE_OK);
+        EXPECT(integer) TO_BE(LLONG_MIN);
+        EXPECT(Cap_ToInt("9223372036854775808", &integer)) TO_BE(CAP_VALUE_RANGE);
+        EXPECT(Cap_ToInt(" 1", &integer)) TO_BE(CAP_VALUE_INVALID);
+        EXPECT(Cap_ToInt("-+1", &integer)) TO_BE(CAP_VALUE_INVALID);
+        EXPECT(Cap_ToInt("12a", &integer)) TO_BE(CAP_VALUE_INVALID);
+        EXPECT(Cap_ToInt(NULL, &integer)) TO_BE(CAP_VALUE_MISSING);
+
+        unsigned long long u64;
+        EXPECT(Cap_ToU64("18446744073709551615", &u64)) TO_BE(CAP_VALUE_OK);
+        EXPECT(u64) TO_BE(18446744073709551615ULL);
+        EXPECT(Cap_ToU64("18446744073709551616", &u64)) TO_BE(CAP_VALUE_RANGE);
+        EXPECT(Cap_ToU64("-1", &u64)) TO_BE(CAP_VALUE_INVALID);
+
+        double real;
+        EXPECT(Cap_ToDouble("2.5", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(2.5);
+        EXPECT(Cap_ToDouble("-0.001e3", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(-1.0);
+        EXPECT(Cap_ToDouble("0.1", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(0.1);
+        EXPECT(Cap_ToDouble("1.7976931348623157e308", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(1.7976931348623157e308);
+        EXPECT(Cap_ToDouble("1e400", &real)) TO_BE(CAP_VALUE_RANGE);
+        EXPECT(Cap_ToDouble(".", &real)) TO_BE(CAP_VALUE_INVALID);
+        EXPECT(Cap_ToDouble("1e", &real)) TO_BE(CAP_VALUE_INVALID);
+
+        // Long mantissas go to strtod(), which must not follow a locale with a decimal comma
+        int commaLocale = setlocale(LC_NUMERIC, "de_DE.UTF-8") != NULL;
+        EXPECT(Cap_ToDouble("3.14159265358979323846264338327950288", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(3.141592653589793);
+        EXPECT(Cap_ToDouble("-2.2250738585072013830902327173324040642192159804623318306e-308", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(-2.2250738585072014e-308);
+        EXPECT(Cap_ToDouble("123456789012345678901234567890", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(1.2345678901234568e29);
+        EXPECT(Cap_ToDouble("0.000000000000000000000000125e-5", &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(1.25e-30);
+        if(commaLocale) setlocale(LC_NUMERIC, "C");
+
+        // 2^53 + 1 is a tie that rounds to even, a nonzero digit far past the 768th one breaks it upwards
+        static char tie[1000] = "9007199254740993.";
+        EXPECT(Cap_ToDouble(tie, &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(9007199254740992.0);
+
+        memset(tie + 17, '0', 900);
+        tie[917] = '1';
+        EXPECT(Cap_ToDouble(tie, &real)) TO_BE(CAP_VALUE_OK);
+        EXPECT(real) TO_BE(9007199254740994.0);
+
+        unsigned long long size;
+        EXPECT(Cap_ToSize("4G", &size)) TO_BE(CAP_VALUE_OK);
+        EXPECT(size) TO_BE(4ULL << 30);
+        EXPECT(Cap_ToSize("512KiB", &size)) TO_BE(CAP_VALUE_OK);
+        EXPECT(size) TO_BE(512ULL << 10);
+        EXPECT(Cap_ToSize("100B", &size)) TO_BE(CAP_VALUE_OK);
+        EXPECT(size) TO_BE(100ULL);
+        EXPECT(Cap_ToSize("16777216T", &size)) TO_BE(CAP_VALUE_RANGE);
+        EXPECT(Cap_ToSize("4X", &size)) TO_BE(CAP_VALUE_INVALID);
+
+        unsigned long long duration;
+        EXPECT(Cap_ToDuration("250ms", &duration)) TO_BE(CAP_VALUE_OK);
+        EXPECT(duration) TO_BE(250000000ULL);
+        EXPECT(Cap_ToDuration("1h30m", &duration)) TO_BE(CAP_VALUE_OK);
+        EXPECT(duration) TO_BE(5400000000000ULL);
+        EXPECT(Cap_ToDuration("5", &duration)) TO_BE(CAP_VALUE_OK);
+        EXPECT(duration) TO_BE(5000000000ULL);
+        EXPECT(Cap_ToDuration("10us", &duration)) TO_BE(CAP_VALUE_OK);
+        EXPECT(duration) TO_BE(10000ULL);
+        EXPECT(Cap_ToDuration("1m5", &duration)) TO_BE(CAP_VALUE_INVALID);
+        EXPECT(Cap_ToDuration("10u", &duration)) TO_BE(CAP_VALUE_INVALID);
+
+        char* argv[] = { "--shards=1024", "-t", "250ms", "-n" };
+        Cap_Iterator args;
+        Cap_Init(4, argv, &args);
+
+        Cap_Item arg;
+        Cap_Next(&args, &arg);
+        EXPECT(Cap_ValueInt(&args, &arg, &integer)) TO_BE(CAP_VALUE_OK);
+        EXPECT(integer) TO_BE(1024);
+
+        Cap_Next(&args, &arg);
+        EXPECT(Cap_ValueDuration(&args, &arg, &duration)) TO_BE(CAP_VALUE_OK);
+        EXPECT(duration) TO_BE(250000000ULL);
+
+        Cap_Next(&args, &arg);
+        EXPECT(Cap_ValueU64(&args, &arg, &u64)) TO_BE(CAP_VALUE_MISSING);
+    }
+
+#if defined(CAP_PROC_SCANNER)
+    IT("scans processes") {
+        char buffer[4096];
+        char* argv[64];
+        signed char types[64];
+
+        Cap_ProcessScanner scanner = {
+            .buffer = buffer,
+            .bufferSize = sizeof(buffer),
+            .argv = argv,
+            .argvCapacity = 64,
+            .tokens = { .capacity = 64, .types = types },
+        };
+
+        struct ProcessSearch search = { .pid = getpid() };
+
+        EXPECT(Cap_ScanProcesses(&scanner, findProcess, &search) > 0) TO_BE_TRUTHY;
+        EXPECT(search.found) TO_BE(1);
+        EXPECT(search.argc) TO_BE(1);
+        EXPECT(search.tokens) TO_BE(0);
+
+        // No room for a char and the terminator
+        scanner.bufferSize = 1;
+        EXPECT(Cap_ScanProcesses(&scanner, findProcess, &search)) TO_BE(-1);
+        scanner.bufferSize = 0;
+        EXPECT(Cap_ScanProcesses(&scanner, findProcess, &search)) TO_BE(-1);
+    }
+#endif // CAP_PROC_SCANNER
 }
\ No newline at end of file